@@ -0,0 +1,525 @@
+/* -*- Mode: C; c-file-style: "gnu"; tab-width: 8; indent-tabs-mode: nil; -*- */
+
+#include <glib.h>
+#include <locale.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gbinpacker.h"
+
+#include <cairo.h>
+#include <pango/pangocairo.h>
+
+/* ************************************************************************** */
+/* the bins: synthetic ones and the ink boxes of real glyphs */
+
+typedef struct BenchDist {
+  const char  *name;
+  const char  *text;      /* NULL for the synthetic one */
+  const guint *sizes;     /* pixel sizes of the font, 0 ends */
+} BenchDist;
+
+static const guint latin_sizes[]  = {10, 12, 14, 16, 20, 24, 32, 0};
+static const guint cjk_sizes[]    = {12, 16, 24, 32, 0};
+static const guint arabic_sizes[] = {12, 16, 20, 24, 32, 0};
+static const guint emoji_sizes[]  = {16, 24, 32, 48, 64, 96, 128, 0};
+
+static const BenchDist bench_dists[] = {
+  {"synthetic", NULL, NULL},
+  {"latin",
+   "The quick brown fox jumps over the lazy dog. "
+   "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG! "
+   "0123456789 ({[<@#$%&*+=>]}) àáâãäåæçèéêëìíîïñòóôõöøùúûüýÿß",
+   latin_sizes},
+  {"cjk",
+   "的一是不了人我在有他这中大来上国个到说们为子和你地出道也时年得就那要下以"
+   "生会自着去之过家学对可她里后小么心多天而能好都然没日于起还发成事只作当想"
+   "看文无开手十用主行方又如前所本见经头面公同三已老从动两长知民样现分将外但"
+   "身些与高意进把法此实回二理美点月明其种声全工己话儿者向情部正名定女问力机"
+   "あいうえおかきくけこさしすせそたちつてとなにぬねのアイウエオカキクケコ"
+   "한국어를배우는것은재미있습니다",
+   cjk_sizes},
+  {"arabic",
+   "بسم الله الرحمن الرحيم العربية لغة جميلة مرحبا بالعالم كيف حالك اليوم "
+   "١٢٣٤٥٦٧٨٩٠ غ ظ ض ذ خ ث ت ش ر ق ص ف ع س ن م ل ك ي ط ح ز و ه د ج ب ا",
+   arabic_sizes},
+  {"emoji",
+   "😀😃😄😁😆😅😂🤣😊😇🙂🙃😉😌😍🥰😘😗😙😚😋😛😝😜🤪🤨🧐🤓😎🤩🥳😏😒😞"
+   "😔😟😕🙁😣😖😫😩🥺😢😭😤😠😡🤬🤯😳🥵🥶😱😨😰😥😓🤗🤔🤭🤫🤥😶😐😑😬🙄"
+   "👍👎👊✊🤛🤜🤞🤟🤘👌🤏👈👉👆👇✋🤚🖐🖖👋🤙💪🙏👀🧠🎃👻💀👽👾🤖💩🔥⭐🌈",
+   emoji_sizes},
+};
+
+/* collect the sizes of the ink boxes of the glyphs in dist->text at
+   every font size of the distribution, the same way the test fixture
+   turns glyphs into bins */
+static GArray *
+bench_glyph_pool(const BenchDist *dist)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  PangoContext *context;
+  PangoLayout *layout;
+  GArray *pool;
+  guint s;
+
+  pool = g_array_new(FALSE, FALSE, sizeof(GRect));
+
+  surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 16, 16);
+  cr = cairo_create(surface);
+  context = pango_cairo_create_context(cr);
+  layout = pango_layout_new(context);
+
+  for (s = 0; dist->sizes[s]; s++)
+    {
+      PangoFontDescription *desc;
+      PangoLayoutIter *li;
+
+      desc = pango_font_description_from_string("Sans");
+      pango_font_description_set_absolute_size(desc,
+                                               dist->sizes[s] * PANGO_SCALE);
+      pango_layout_set_font_description(layout, desc);
+      pango_font_description_free(desc);
+
+      pango_layout_set_text(layout, dist->text, -1);
+
+      li = pango_layout_get_iter(layout);
+
+      do {
+        const PangoLayoutRun *run = pango_layout_iter_get_run_readonly(li);
+        const PangoGlyphItem *gi = (PangoGlyphItem *) run;
+        gint i;
+
+        if (!run)
+          continue;
+
+        for (i = 0; i < gi->glyphs->num_glyphs; i++)
+          {
+            PangoGlyph glyph = gi->glyphs->glyphs[i].glyph;
+            PangoRectangle ink;
+            GRect gr = {0, };
+
+            pango_font_get_glyph_extents(gi->item->analysis.font,
+                                         glyph, &ink, NULL);
+            pango_extents_to_pixels(&ink, NULL);
+
+            /* blanks take no room in an atlas */
+            if (ink.width <= 0 || ink.height <= 0)
+              continue;
+
+            gr.width = ink.width + 1;
+            gr.height = ink.height + 1;
+            g_array_append_val(pool, gr);
+          }
+
+      } while (pango_layout_iter_next_run(li));
+
+      pango_layout_iter_free(li);
+    }
+
+  g_object_unref(layout);
+  g_object_unref(context);
+  cairo_destroy(cr);
+  cairo_surface_destroy(surface);
+
+  return pool;
+}
+
+/* n bins drawn from the distribution with a fixed seed, so every
+   packer gets the very same sequence; NULL if there are no glyphs
+   to draw from (no font for the script) */
+static GArray *
+bench_bins(const BenchDist *dist,
+           GArray          *pool,
+           guint            n)
+{
+  GArray *bins;
+  GRand *rand;
+  guint i;
+
+  if (dist->text && pool->len == 0)
+    return NULL;
+
+  bins = g_array_sized_new(FALSE, FALSE, sizeof(GRect), n);
+  rand = g_rand_new_with_seed(0x5eed + n);
+
+  for (i = 0; i < n; i++)
+    {
+      GRect r = {0, };
+
+      if (dist->text)
+        r = g_array_index(pool, GRect, g_rand_int_range(rand, 0, pool->len));
+      else
+        {
+          r.width = g_rand_int_range(rand, 4, 65);
+          r.height = g_rand_int_range(rand, 4, 65);
+        }
+
+      r.id = GUINT_TO_POINTER(i + 1);
+      g_array_append_val(bins, r);
+    }
+
+  g_rand_free(rand);
+  return bins;
+}
+
+/* a square atlas with about the area of all the bins, so the packers
+   get to run close to full */
+static guint
+bench_atlas_side(GArray *bins)
+{
+  guint64 area = 0;
+  guint side = 64;
+  guint i;
+
+  for (i = 0; i < bins->len; i++)
+    area += g_rect_area(&g_array_index(bins, GRect, i));
+
+  while ((guint64) side * side < area)
+    side += 64;
+
+  return side;
+}
+
+/* ************************************************************************** */
+/* the packers */
+
+typedef enum BenchPacker {
+  BENCH_GUILLOTINE,
+  BENCH_MAX_RECTS,
+  BENCH_SKYLINE,
+  BENCH_SHELF,
+} BenchPacker;
+
+typedef struct BenchConfig {
+  BenchPacker          packer;
+  GRectFit             fit;
+  GRectSplit           split;
+  GSkylinePackerLevel  level;
+  gboolean             wastemap;
+} BenchConfig;
+
+static const char *packer_names[] = {
+  "guillotine", "max-rects", "skyline", "shelf",
+};
+
+static const char *fit_names[] = {
+  "area-best", "area-worst",
+  "short-side-best", "short-side-worst",
+  "long-side-best", "long-side-worst",
+};
+
+static const char *split_names[] = {
+  "area-max", "area-min",
+};
+
+static const char *level_names[] = {
+  "bottom-left", "min-waste",
+};
+
+/* every packer with every combination of the methods it has */
+static GArray *
+bench_configs(void)
+{
+  GArray *configs;
+  BenchConfig c;
+  guint f, s;
+
+  configs = g_array_new(FALSE, FALSE, sizeof(BenchConfig));
+
+  for (f = G_RECT_FIT_AREA_BEST; f <= G_RECT_FIT_LONG_SIDE_WORST; f++)
+    for (s = G_RECT_SPLIT_AREA_MAX; s <= G_RECT_SPLIT_AREA_MIN; s++)
+      {
+        c = (BenchConfig) {BENCH_GUILLOTINE, f, s, 0, FALSE};
+        g_array_append_val(configs, c);
+      }
+
+  for (f = G_RECT_FIT_AREA_BEST; f <= G_RECT_FIT_LONG_SIDE_WORST; f++)
+    {
+      c = (BenchConfig) {BENCH_MAX_RECTS, f, 0, 0, FALSE};
+      g_array_append_val(configs, c);
+    }
+
+  for (s = GSP_LEVEL_BOTTOM_LEFT; s <= GSP_LEVEL_MIN_WASTE; s++)
+    for (f = 0; f < 2; f++)
+      {
+        c = (BenchConfig) {BENCH_SKYLINE, 0, 0, s, f};
+        g_array_append_val(configs, c);
+      }
+
+  c = (BenchConfig) {BENCH_SHELF, 0, 0, 0, FALSE};
+  g_array_append_val(configs, c);
+
+  return configs;
+}
+
+static GBinPacker *
+bench_packer_new(const BenchConfig *c,
+                 guint              side)
+{
+  switch (c->packer)
+    {
+    case BENCH_GUILLOTINE:
+      return g_object_new(G_TYPE_GUILLOTINE_PACKER,
+                          "width", side,
+                          "height", side,
+                          "fit-method", c->fit,
+                          "split-method", c->split,
+                          NULL);
+
+    case BENCH_MAX_RECTS:
+      return g_object_new(G_TYPE_MAX_RECTS_PACKER,
+                          "width", side,
+                          "height", side,
+                          "fit-method", c->fit,
+                          NULL);
+
+    case BENCH_SKYLINE:
+      return g_object_new(G_TYPE_SKYLINE_PACKER,
+                          "width", side,
+                          "height", side,
+                          "level", c->level,
+                          "use-wastemap", c->wastemap,
+                          NULL);
+
+    default:
+      return g_object_new(G_TYPE_SHELF_PACKER,
+                          "width", side,
+                          "height", side,
+                          NULL);
+    }
+}
+
+/* the size of the structure each packer searches for a place: the
+   free rects, the skyline segments or the shelves */
+static guint
+bench_free_list(GBinPacker  *packer,
+                BenchPacker  kind)
+{
+  GBinPackerStats stats;
+
+  g_bin_packer_get_stats(packer, &stats);
+
+  if (kind == BENCH_SKYLINE || kind == BENCH_SHELF)
+    return stats.n_segments;
+
+  return stats.n_free_rects;
+}
+
+/* ************************************************************************** */
+
+typedef struct BenchResult {
+  guint   placed;
+  guint   failed;
+  gdouble seconds;         /* all of them */
+  gdouble failed_seconds;  /* the ones that did not fit */
+  gfloat  occupancy;
+  guint   free_list;
+} BenchResult;
+
+/* place the bins one after the other with g_bin_packer_pack(), the
+   way an atlas is fed glyphs as they show up; the batch insert()
+   re-scores every pending bin per placement and would not finish
+   the larger sets in a sensible time. Once the atlas fills up the
+   misses cost something else than the hits, so every call is
+   charged to one or the other */
+static void
+bench_run(const BenchConfig *c,
+          GArray            *bins,
+          guint              side,
+          BenchResult       *res)
+{
+  GBinPacker *packer;
+  GRect *rects;
+  gint64 start, last, failed = 0;
+  guint placed = 0;
+  guint i;
+
+  rects = g_new(GRect, bins->len);
+  memcpy(rects, bins->data, bins->len * sizeof(GRect));
+  packer = bench_packer_new(c, side);
+
+  start = last = g_get_monotonic_time();
+
+  for (i = 0; i < bins->len; i++)
+    {
+      const gboolean fit = g_bin_packer_pack(packer, rects + i);
+      const gint64 now = g_get_monotonic_time();
+
+      if (fit)
+        placed++;
+      else
+        failed += now - last;
+
+      last = now;
+    }
+
+  res->seconds = (last - start) / (gdouble) G_USEC_PER_SEC;
+  res->failed_seconds = failed / (gdouble) G_USEC_PER_SEC;
+  res->placed = placed;
+  res->failed = bins->len - placed;
+  res->occupancy = g_bin_packer_occupancy(packer);
+  res->free_list = bench_free_list(packer, c->packer);
+
+  g_object_unref(packer);
+  g_free(rects);
+}
+
+static void
+bench_print(const BenchConfig *c,
+            const char        *dist,
+            guint              n_bins,
+            guint              side,
+            const BenchResult *res,
+            gboolean           first)
+{
+  /* the rates are of the placements alone */
+  gdouble secs = MAX(res->seconds - res->failed_seconds, 1e-9);
+
+  printf("%s    {\"packer\": \"%s\"", first ? "" : ",\n",
+         packer_names[c->packer]);
+
+  if (c->packer == BENCH_GUILLOTINE || c->packer == BENCH_MAX_RECTS)
+    printf(", \"fit\": \"%s\"", fit_names[c->fit]);
+  if (c->packer == BENCH_GUILLOTINE)
+    printf(", \"split\": \"%s\"", split_names[c->split]);
+  if (c->packer == BENCH_SKYLINE)
+    printf(", \"level\": \"%s\", \"wastemap\": %s",
+           level_names[c->level], c->wastemap ? "true" : "false");
+
+  printf(", \"dist\": \"%s\", \"bins\": %u, \"atlas\": %u"
+         ", \"placed\": %u, \"failed\": %u, \"seconds\": %.6f"
+         ", \"failed_seconds\": %.6f, \"rects_per_s\": %.1f"
+         ", \"ns_per_placement\": %.1f, \"occupancy\": %.4f"
+         ", \"free_list\": %u}",
+         dist, n_bins, side,
+         res->placed, res->failed, res->seconds, res->failed_seconds,
+         res->placed / secs, secs * 1e9 / MAX(res->placed, 1),
+         res->occupancy, res->free_list);
+
+  fflush(stdout);
+}
+
+/* ************************************************************************** */
+
+static gboolean
+bench_wanted(const char *list,
+             const char *name)
+{
+  gchar **names;
+  gboolean found;
+
+  if (list == NULL)
+    return TRUE;
+
+  names = g_strsplit(list, ",", -1);
+  found = g_strv_contains((const gchar * const *) names, name);
+  g_strfreev(names);
+
+  return found;
+}
+
+int
+main(int argc, char **argv)
+{
+  static gchar *opt_sizes = NULL;
+  static gchar *opt_packers = NULL;
+  static gchar *opt_dists = NULL;
+  static GOptionEntry entries[] = {
+    {"sizes", 's', 0, G_OPTION_ARG_STRING, &opt_sizes,
+     "Comma separated numbers of bins (default: 1000,10000,100000)", "N,..."},
+    {"packers", 'p', 0, G_OPTION_ARG_STRING, &opt_packers,
+     "Only run these packers (guillotine,max-rects,skyline,shelf)", "NAME,..."},
+    {"dists", 'd', 0, G_OPTION_ARG_STRING, &opt_dists,
+     "Only use these distributions (synthetic,latin,cjk,arabic,emoji)", "NAME,..."},
+    {NULL}
+  };
+  GOptionContext *octx;
+  GError *error = NULL;
+  GArray *configs;
+  gchar **sizes;
+  gboolean first = TRUE;
+  guint d, i, k;
+
+  setlocale(LC_ALL, "");
+
+  octx = g_option_context_new("- benchmark the bin packers");
+  g_option_context_add_main_entries(octx, entries, NULL);
+
+  if (!g_option_context_parse(octx, &argc, &argv, &error))
+    {
+      g_printerr("%s\n", error->message);
+      g_error_free(error);
+      g_option_context_free(octx);
+      return 1;
+    }
+
+  g_option_context_free(octx);
+
+  /* the json has to read the same everywhere */
+  setlocale(LC_NUMERIC, "C");
+
+  sizes = g_strsplit(opt_sizes ? opt_sizes : "1000,10000,100000", ",", -1);
+  configs = bench_configs();
+
+  printf("{\"results\": [\n");
+
+  for (d = 0; d < G_N_ELEMENTS(bench_dists); d++)
+    {
+      const BenchDist *dist = bench_dists + d;
+      GArray *pool = NULL;
+
+      if (!bench_wanted(opt_dists, dist->name))
+        continue;
+
+      if (dist->text)
+        pool = bench_glyph_pool(dist);
+
+      for (k = 0; sizes[k]; k++)
+        {
+          guint n = (guint) g_ascii_strtoull(sizes[k], NULL, 10);
+          GArray *bins;
+          guint side;
+
+          if (n == 0)
+            continue;
+
+          bins = bench_bins(dist, pool, n);
+          if (bins == NULL)
+            {
+              g_printerr("no glyphs for %s, skipping it\n", dist->name);
+              break;
+            }
+
+          side = bench_atlas_side(bins);
+
+          for (i = 0; i < configs->len; i++)
+            {
+              const BenchConfig *c = &g_array_index(configs, BenchConfig, i);
+              BenchResult res;
+
+              if (!bench_wanted(opt_packers, packer_names[c->packer]))
+                continue;
+
+              bench_run(c, bins, side, &res);
+              bench_print(c, dist->name, n, side, &res, first);
+              first = FALSE;
+            }
+
+          g_array_free(bins, TRUE);
+        }
+
+      if (pool)
+        g_array_free(pool, TRUE);
+    }
+
+  printf("\n]}\n");
+
+  g_array_free(configs, TRUE);
+  g_strfreev(sizes);
+  g_free(opt_sizes);
+  g_free(opt_packers);
+  g_free(opt_dists);
+
+  return 0;
+}
@@ -3,6 +3,11 @@
 #include <glib.h>
 #include <string.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RECT_HAVE_X86_SIMD 1
+#endif
+
 #include "gbinpacker.h"
 
 /* ************************************************************************** */
@@ -246,858 +251,6259 @@ g_rect_fit (const GRect *o,
 }
 
 
-/* ************************************************************************** */
+/* the scan kernels: best free rect for a single bw x bh bin among
+   the first n of the free widths fw and heights fh, scored like
+   g_rect_fit() with exact matches first. *pos is G_MAXUINT if
+   nothing fits, ties go to the lower position */
+typedef void (*RectScanFunc) (const guint *fw,
+                              const guint *fh,
+                              guint        n,
+                              guint        bw,
+                              guint        bh,
+                              GRectFit     method,
+                              gint        *score,
+                              guint       *pos);
+
+/* carry on from position from with what is in score and pos */
+static void
+rect_scan_from(const guint *fw,
+               const guint *fh,
+               guint        from,
+               guint        n,
+               guint        bw,
+               guint        bh,
+               GRectFit     method,
+               gint        *score,
+               guint       *pos)
+{
+  GRect b = {0, };
+  guint i;
 
-typedef struct _GBinPackerPrivate {
-  guint width;
-  guint height;
+  b.width = bw;
+  b.height = bh;
 
-  GArray *rects;
+  for (i = from; i < n && *score != G_MININT; i++)
+    {
+      GRect f = {0, };
+      gint s;
 
-} GBinPackerPrivate;
+      if (fw[i] < bw || fh[i] < bh)
+        continue;
 
-enum {
-    PROP_BP_0,
-    PROP_WIDTH,
-    PROP_HEIGHT,
-    PROP_RECTS,
-    PROP_BP_LAST
-};
+      f.width = fw[i];
+      f.height = fh[i];
 
-static GParamSpec *bp_props[PROP_BP_LAST] = { NULL, };
+      if (g_rect_size_equal(&f, &b))
+        s = G_MININT;
+      else
+        s = g_rect_fit(&f, &b, method);
 
-G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE(GBinPacker,
-                                    g_bin_packer,
-                                    G_TYPE_OBJECT);
+      if (*pos == G_MAXUINT || s < *score)
+        {
+          *score = s;
+          *pos = i;
+        }
+    }
+}
 
-#define BP_GET_PRIV(obj) \
-    ((GBinPackerPrivate *) g_bin_packer_get_instance_private(G_BIN_PACKER(obj)))
+static void
+rect_scan_c(const guint *fw,
+            const guint *fh,
+            guint        n,
+            guint        bw,
+            guint        bh,
+            GRectFit     method,
+            gint        *score,
+            guint       *pos)
+{
+  *score = G_MAXINT;
+  *pos = G_MAXUINT;
 
+  rect_scan_from(fw, fh, 0, n, bw, bh, method, score, pos);
+}
+
+#ifdef RECT_HAVE_X86_SIMD
+
+/* the vector kernels keep the best score and its position per lane,
+   taking only strictly better ones so that each lane keeps the first
+   of its ties, and fold the lanes together in the end. A fit that
+   scores G_MAXINT looks like no fit to them, in the unlikely case
+   that this is the best there is the scalar kernel has to redo it */
 static void
-g_bin_packer_finalize(GObject *object)
+rect_scan_fold(const gint  *lane_score,
+               const guint *lane_pos,
+               guint        n_lanes,
+               gint        *score,
+               guint       *pos)
 {
-    GBinPacker *bp = G_BIN_PACKER(object);
-    GBinPackerPrivate *priv = BP_GET_PRIV(bp);
+  guint l;
+
+  for (l = 0; l < n_lanes; l++)
+    {
+      if (lane_pos[l] == G_MAXUINT)
+        continue;
 
-    g_array_free(priv->rects, TRUE);
+      if (*pos == G_MAXUINT || lane_score[l] < *score ||
+          (lane_score[l] == *score && lane_pos[l] < *pos))
+        {
+          *score = lane_score[l];
+          *pos = lane_pos[l];
+        }
+    }
 }
 
+__attribute__((target("sse4.1")))
 static void
-g_bin_packer_get_property(GObject    *object,
-			  guint       prop_id,
-			  GValue     *value,
-			  GParamSpec *pspec)
+rect_scan_sse41(const guint *fw,
+                const guint *fh,
+                guint        n,
+                guint        bw,
+                guint        bh,
+                GRectFit     method,
+                gint        *score,
+                guint       *pos)
 {
-  GBinPacker *bp = G_BIN_PACKER(object);
-  GBinPackerPrivate *priv = BP_GET_PRIV(bp);
+  const __m128i vbw = _mm_set1_epi32(bw);
+  const __m128i vbh = _mm_set1_epi32(bh);
+  const __m128i varea = _mm_set1_epi32(bw * bh);
+  const __m128i vmax = _mm_set1_epi32(G_MAXINT);
+  const __m128i vmin = _mm_set1_epi32(G_MININT);
+  const __m128i zero = _mm_setzero_si128();
+  __m128i best = vmax;
+  __m128i best_pos = _mm_set1_epi32(-1);
+  __m128i idx = _mm_setr_epi32(0, 1, 2, 3);
+  __m128i any_fit = zero;
+  gint lane_score[4];
+  guint lane_pos[4];
+  gboolean exact_seen = FALSE;
+  guint i;
 
-  switch (prop_id) {
+  for (i = 0; i + 4 <= n && !exact_seen; i += 4)
+    {
+      const __m128i w = _mm_loadu_si128((const __m128i *) (fw + i));
+      const __m128i h = _mm_loadu_si128((const __m128i *) (fh + i));
+      __m128i fit, exact, dw, dh, s, lt;
 
-  case PROP_WIDTH:
-    g_value_set_uint(value, priv->width);
-    break;
+      fit = _mm_and_si128(_mm_cmpeq_epi32(_mm_max_epu32(w, vbw), w),
+                          _mm_cmpeq_epi32(_mm_max_epu32(h, vbh), h));
 
-  case PROP_HEIGHT:
-    g_value_set_uint(value, priv->height);
-    break;
+      if (!_mm_testz_si128(fit, fit))
+        {
+          exact = _mm_and_si128(_mm_cmpeq_epi32(w, vbw),
+                                _mm_cmpeq_epi32(h, vbh));
+          dw = _mm_sub_epi32(w, vbw);
+          dh = _mm_sub_epi32(h, vbh);
+
+          switch (method)
+            {
+            case G_RECT_FIT_AREA_BEST:
+            case G_RECT_FIT_AREA_WORST:
+              s = _mm_sub_epi32(_mm_mullo_epi32(w, h), varea);
+              break;
+            case G_RECT_FIT_SHORT_SIDE_BEST:
+            case G_RECT_FIT_SHORT_SIDE_WORST:
+              s = _mm_min_epi32(dw, dh);
+              break;
+            default:
+              s = _mm_max_epi32(dw, dh);
+              break;
+            }
+
+          if (!G_RECT_FIT_IS_BEST(method))
+            s = _mm_sub_epi32(zero, s);
+
+          s = _mm_blendv_epi8(s, vmin, exact);
+          s = _mm_blendv_epi8(vmax, s, fit);
+          any_fit = _mm_or_si128(any_fit, fit);
+
+          lt = _mm_cmpgt_epi32(best, s);
+          best = _mm_blendv_epi8(best, s, lt);
+          best_pos = _mm_blendv_epi8(best_pos, idx, lt);
+
+          /* nothing further on can beat that */
+          exact_seen = !_mm_testz_si128(exact, exact);
+        }
 
-  case PROP_RECTS:
-    g_value_set_boxed(value, priv->rects);
-    break;
-  }
+      idx = _mm_add_epi32(idx, _mm_set1_epi32(4));
+    }
+
+  _mm_storeu_si128((__m128i *) lane_score, best);
+  _mm_storeu_si128((__m128i *) lane_pos, best_pos);
+
+  *score = G_MAXINT;
+  *pos = G_MAXUINT;
+
+  rect_scan_fold(lane_score, lane_pos, 4, score, pos);
+  rect_scan_from(fw, fh, i, n, bw, bh, method, score, pos);
 
+  if (*score == G_MAXINT && !_mm_testz_si128(any_fit, any_fit))
+    rect_scan_c(fw, fh, n, bw, bh, method, score, pos);
 }
 
+__attribute__((target("avx2")))
 static void
-g_bin_packer_set_property(GObject     *object,
-			  guint        prop_id,
-			  const GValue *value,
-			  GParamSpec   *pspec)
+rect_scan_avx2(const guint *fw,
+               const guint *fh,
+               guint        n,
+               guint        bw,
+               guint        bh,
+               GRectFit     method,
+               gint        *score,
+               guint       *pos)
 {
-    GBinPacker *bp = G_BIN_PACKER(object);
-    GBinPackerPrivate *priv = BP_GET_PRIV(bp);
+  const __m256i vbw = _mm256_set1_epi32(bw);
+  const __m256i vbh = _mm256_set1_epi32(bh);
+  const __m256i varea = _mm256_set1_epi32(bw * bh);
+  const __m256i vmax = _mm256_set1_epi32(G_MAXINT);
+  const __m256i vmin = _mm256_set1_epi32(G_MININT);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i best = vmax;
+  __m256i best_pos = _mm256_set1_epi32(-1);
+  __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i any_fit = zero;
+  gint lane_score[8];
+  guint lane_pos[8];
+  gboolean exact_seen = FALSE;
+  guint i;
 
-    switch (prop_id) {
+  for (i = 0; i + 8 <= n && !exact_seen; i += 8)
+    {
+      const __m256i w = _mm256_loadu_si256((const __m256i *) (fw + i));
+      const __m256i h = _mm256_loadu_si256((const __m256i *) (fh + i));
+      __m256i fit, exact, dw, dh, s, lt;
 
-    case PROP_WIDTH:
-      priv->width = g_value_get_uint(value);
-      break;
+      fit = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_max_epu32(w, vbw), w),
+                             _mm256_cmpeq_epi32(_mm256_max_epu32(h, vbh), h));
 
-    case PROP_HEIGHT:
-      priv->height = g_value_get_uint(value);
-      break;
+      if (!_mm256_testz_si256(fit, fit))
+        {
+          exact = _mm256_and_si256(_mm256_cmpeq_epi32(w, vbw),
+                                   _mm256_cmpeq_epi32(h, vbh));
+          dw = _mm256_sub_epi32(w, vbw);
+          dh = _mm256_sub_epi32(h, vbh);
+
+          switch (method)
+            {
+            case G_RECT_FIT_AREA_BEST:
+            case G_RECT_FIT_AREA_WORST:
+              s = _mm256_sub_epi32(_mm256_mullo_epi32(w, h), varea);
+              break;
+            case G_RECT_FIT_SHORT_SIDE_BEST:
+            case G_RECT_FIT_SHORT_SIDE_WORST:
+              s = _mm256_min_epi32(dw, dh);
+              break;
+            default:
+              s = _mm256_max_epi32(dw, dh);
+              break;
+            }
+
+          if (!G_RECT_FIT_IS_BEST(method))
+            s = _mm256_sub_epi32(zero, s);
+
+          s = _mm256_blendv_epi8(s, vmin, exact);
+          s = _mm256_blendv_epi8(vmax, s, fit);
+          any_fit = _mm256_or_si256(any_fit, fit);
+
+          lt = _mm256_cmpgt_epi32(best, s);
+          best = _mm256_blendv_epi8(best, s, lt);
+          best_pos = _mm256_blendv_epi8(best_pos, idx, lt);
+
+          exact_seen = !_mm256_testz_si256(exact, exact);
+        }
+
+      idx = _mm256_add_epi32(idx, _mm256_set1_epi32(8));
     }
+
+  _mm256_storeu_si256((__m256i *) lane_score, best);
+  _mm256_storeu_si256((__m256i *) lane_pos, best_pos);
+
+  *score = G_MAXINT;
+  *pos = G_MAXUINT;
+
+  rect_scan_fold(lane_score, lane_pos, 8, score, pos);
+  rect_scan_from(fw, fh, i, n, bw, bh, method, score, pos);
+
+  if (*score == G_MAXINT && !_mm256_testz_si256(any_fit, any_fit))
+    rect_scan_c(fw, fh, n, bw, bh, method, score, pos);
 }
 
+#endif
 
+/* picked once by the packers class_init */
+static RectScanFunc rect_scan = rect_scan_c;
 
 static void
-g_bin_packer_class_init(GBinPackerClass *klass)
+rect_scan_resolve(void)
 {
-    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+#ifdef RECT_HAVE_X86_SIMD
+  __builtin_cpu_init();
 
-    gobject_class->finalize     = g_bin_packer_finalize;
-    gobject_class->get_property = g_bin_packer_get_property;
-    gobject_class->set_property = g_bin_packer_set_property;
+  if (g_getenv("G_BIN_PACKER_NO_SIMD") != NULL)
+    return;
 
-    bp_props[PROP_WIDTH] =
-      g_param_spec_uint("width",
-			NULL, NULL,
-			0, G_MAXUINT, 0,
-			G_PARAM_CONSTRUCT_ONLY |
-			G_PARAM_READWRITE |
-			G_PARAM_STATIC_NICK);
+  if (__builtin_cpu_supports("avx2"))
+    rect_scan = rect_scan_avx2;
+  else if (__builtin_cpu_supports("sse4.1"))
+    rect_scan = rect_scan_sse41;
+#endif
+}
 
-    bp_props[PROP_HEIGHT] =
-      g_param_spec_uint("height",
-			NULL, NULL,
-			0, G_MAXUINT, 0,
-			G_PARAM_CONSTRUCT_ONLY |
-			G_PARAM_READWRITE |
-			G_PARAM_STATIC_NICK);
+/* ************************************************************************** */
 
-    bp_props[PROP_RECTS] =
-      g_param_spec_boxed("rects",
-			 NULL, NULL,
-			 G_TYPE_ARRAY,
-			 G_PARAM_READWRITE |
-			 G_PARAM_STATIC_NICK);
+/* a small open addressing hash map from 64 bit keys (usually a
+   packed pair of coordinates) to positions in some array */
+typedef struct PosMap {
+  guint64 *keys;
+  guint   *vals;
+  guint    mask;     /* size - 1, size is a power of two */
+  guint    n_items;
+} PosMap;
 
-    g_object_class_install_properties(gobject_class,
-                                      PROP_BP_LAST,
-                                      bp_props);
+#define POS_MAP_EMPTY G_MAXUINT64
+#define POS_MAP_KEY(a, b) (((guint64) (a) << 32) | (guint32) (b))
+
+static inline guint
+pos_map_hash(guint64 key)
+{
+  /* the murmur3 finalizer */
+  key ^= key >> 33;
+  key *= G_GUINT64_CONSTANT(0xff51afd7ed558ccd);
+  key ^= key >> 33;
+  key *= G_GUINT64_CONSTANT(0xc4ceb9fe1a85ec53);
+  key ^= key >> 33;
+
+  return (guint) key;
 }
 
 static void
-g_bin_packer_init(GBinPacker *bp)
+pos_map_init(PosMap *map,
+             guint   size)
 {
-  GBinPackerPrivate *priv = BP_GET_PRIV(bp);
+  guint i;
+
+  map->mask = size - 1;
+  map->n_items = 0;
+  map->keys = g_new(guint64, size);
+  map->vals = g_new(guint, size);
 
-  priv->rects = g_array_new(FALSE, FALSE, sizeof(GRect));
+  for (i = 0; i < size; i++)
+    map->keys[i] = POS_MAP_EMPTY;
 }
 
-gfloat g_bin_packer_occupancy(GBinPacker *packer)
+static void
+pos_map_clear(PosMap *map)
 {
-  GBinPackerPrivate *priv = BP_GET_PRIV(packer);
-  guint64 used = 0;
-  gdouble total;
-  gsize i;
-
-  for (i = 0; i < priv->rects->len; i++)
-    {
-      const GRect *r = &g_array_index(priv->rects, GRect, i);
-      used += g_rect_area(r);
-    }
-
-  total = priv->height * priv->width;
-  return used / total;
+  g_clear_pointer(&map->keys, g_free);
+  g_clear_pointer(&map->vals, g_free);
+  map->mask = 0;
+  map->n_items = 0;
 }
 
-/* ************************************************************************** */
+static guint
+pos_map_slot(const PosMap *map,
+             guint64       key)
+{
+  guint i = pos_map_hash(key) & map->mask;
 
-struct _GGuillotinePacker {
-  GBinPacker parent;
+  while (map->keys[i] != key && map->keys[i] != POS_MAP_EMPTY)
+    i = (i + 1) & map->mask;
 
-  GArray    *rects_free;
+  return i;
+}
 
-  GRectFit   fit_method;
-  GRectSplit split_method;
-  gboolean   merge_free;
+static gboolean
+pos_map_lookup(const PosMap *map,
+               guint64       key,
+               guint        *val)
+{
+  const guint i = pos_map_slot(map, key);
 
-};
+  if (map->keys[i] == POS_MAP_EMPTY)
+    return FALSE;
 
-enum {
-  PROP_GP_0,
-  PROP_GP_FREE_RECTS,
-  PROP_GP_MERGE_FREE,
-  PROP_GP_FIT_METHOD,
-  PROP_GP_SPLIT_METHOD,
-  PROP_GP_LAST
-};
-static GParamSpec *gp_props[PROP_GP_LAST] = { NULL, };
+  *val = map->vals[i];
+  return TRUE;
+}
 
-G_DEFINE_TYPE(GGuillotinePacker, g_guillotine_packer, G_TYPE_BIN_PACKER);
+static void pos_map_insert(PosMap *map, guint64 key, guint val);
 
 static void
-g_guillotine_packer_finalize(GObject *obj)
+pos_map_grow(PosMap *map)
 {
-  GGuillotinePacker *gp = G_GUILLOTINE_PACKER(obj);
+  PosMap old = *map;
+  guint i;
 
-  g_array_free(gp->rects_free, TRUE);
+  pos_map_init(map, (old.mask + 1) * 2);
 
-  G_OBJECT_CLASS(g_guillotine_packer_parent_class)->finalize(obj);
+  for (i = 0; i <= old.mask; i++)
+    if (old.keys[i] != POS_MAP_EMPTY)
+      pos_map_insert(map, old.keys[i], old.vals[i]);
+
+  pos_map_clear(&old);
 }
 
 static void
-g_guillotine_packer_get_property(GObject    *object,
-                                 guint       prop_id,
-                                 GValue     *value,
-                                 GParamSpec *pspec)
+pos_map_insert(PosMap  *map,
+               guint64  key,
+               guint    val)
 {
-  GGuillotinePacker *gp = G_GUILLOTINE_PACKER(object);
+  guint i;
 
-  switch (prop_id) {
-  case PROP_GP_FREE_RECTS:
-    g_value_set_boxed(value, gp->rects_free);
-    break;
+  /* keep the load factor below 1/2 */
+  if ((map->n_items + 1) * 2 > map->mask + 1)
+    pos_map_grow(map);
 
-  case PROP_GP_MERGE_FREE:
-    g_value_set_boolean(value, gp->merge_free);
-    break;
+  i = pos_map_slot(map, key);
 
-  case PROP_GP_FIT_METHOD:
-    g_value_set_uint(value, gp->fit_method);
-    break;
+  if (map->keys[i] == POS_MAP_EMPTY)
+    map->n_items++;
 
-  case PROP_GP_SPLIT_METHOD:
-    g_value_set_uint(value, gp->split_method);
-    break;
-  }
+  map->keys[i] = key;
+  map->vals[i] = val;
 }
 
-
 static void
-g_guillotine_packer_set_property(GObject      *object,
-                                 guint         prop_id,
-                                 const GValue *value,
-                                 GParamSpec   *pspec)
+pos_map_remove(PosMap  *map,
+               guint64  key)
 {
-  GGuillotinePacker *gp = G_GUILLOTINE_PACKER(object);
+  guint i = pos_map_slot(map, key);
+  guint k;
 
-  switch (prop_id) {
-  case PROP_GP_MERGE_FREE:
-     gp->merge_free = g_value_get_boolean(value);
-    break;
+  if (map->keys[i] == POS_MAP_EMPTY)
+    return;
 
-  case PROP_GP_FIT_METHOD:
-    gp->fit_method = g_value_get_uint(value);
-    break;
+  map->n_items--;
 
-  case PROP_GP_SPLIT_METHOD:
-    gp->split_method = g_value_get_uint(value);
-    break;
-  }
+  /* backward shift deletion: move later members of the probe
+     sequence into the hole so lookups never need tombstones */
+  for (k = (i + 1) & map->mask;
+       map->keys[k] != POS_MAP_EMPTY;
+       k = (k + 1) & map->mask)
+    {
+      const guint home = pos_map_hash(map->keys[k]) & map->mask;
+
+      /* k can move to i iff its home is not in (i, k] */
+      if ((k > i && (home <= i || home > k)) ||
+          (k < i && (home <= i && home > k)))
+        {
+          map->keys[i] = map->keys[k];
+          map->vals[i] = map->vals[k];
+          i = k;
+        }
+    }
+
+  map->keys[i] = POS_MAP_EMPTY;
 }
 
+/* ************************************************************************** */
 
-static void
-g_guillotine_packer_constructed(GObject *obj)
-{
-  GGuillotinePacker *gp = G_GUILLOTINE_PACKER(obj);
-  GBinPackerPrivate *priv = BP_GET_PRIV(gp);
-  GRect *r;
+typedef struct _GBinPackerPrivate {
+  guint width;
+  guint height;
 
-  G_OBJECT_CLASS(g_guillotine_packer_parent_class)->constructed(obj);
+  /* the packed rects: 16 bit boxes with the ids next to them as long
+     as everything fits, which for GPU atlas pages it always does.
+     The first rect that does not moves them all to wide GRects in
+     rects, for good. Whether a box is turned is one bit of turned,
+     which keeps the boxes at 8 bytes */
+  GArray *boxes;
+  GArray *ids;
+  GArray *turned;
+  GArray *rects;
 
-  gp->rects_free->len = 1;
+  /* id to the slot of a rect packed for it, with BP_SLOT_SHADOWED
+     set if there may be others for the same id */
+  PosMap  slots;
 
-  r = &g_array_index(gp->rects_free, GRect, 0);
-  r->x = r->y = 0;
+  guint64 used_area;   /* of the packed rects, kept as they change */
 
-  r->width  = priv->width;
-  r->height = priv->height;
-}
+  gboolean allow_rotation;
+  guint    padding;    /* kept free right of and below every rect */
+  guint    alignment;  /* the rects start at multiples of it */
 
-static void
-g_guillotine_packer_init(GGuillotinePacker *gp)
-{
-  gp->rects_free = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
-}
+  /* NULL unless counting; the waste map of a skyline packer
+     counts into the one of the skyline */
+  GBinPackerCounters *counters;
+  gboolean            counting;
 
-static void
-g_guillotine_packer_class_init(GGuillotinePackerClass *klass)
-{
-  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GBinPackerTraceFunc trace;
+  gpointer            trace_data;
 
-  gobject_class->finalize     = g_guillotine_packer_finalize;
-  gobject_class->get_property = g_guillotine_packer_get_property;
-  gobject_class->set_property = g_guillotine_packer_set_property;
-  gobject_class->constructed  = g_guillotine_packer_constructed;
+} GBinPackerPrivate;
 
-  gp_props[PROP_GP_FREE_RECTS] =
-    g_param_spec_boxed("free-rects",
-                       NULL, NULL,
-                       G_TYPE_ARRAY,
-                       G_PARAM_READABLE |
-                       G_PARAM_STATIC_NICK);
+/* a single branch when not counting */
+#define BP_COUNT(priv, what, n)                         \
+  G_STMT_START {                                        \
+    if (G_UNLIKELY((priv)->counters != NULL))           \
+      (priv)->counters->what += (n);                    \
+  } G_STMT_END
 
-  gp_props[PROP_GP_MERGE_FREE] =
-    g_param_spec_boolean("merge-free", NULL, NULL, TRUE,
-                         G_PARAM_READWRITE |
-                         G_PARAM_CONSTRUCT_ONLY |
-                         G_PARAM_STATIC_NICK);
+typedef struct _BPBox {
+  guint16 x;
+  guint16 y;
+  guint16 width;
+  guint16 height;
+} BPBox;
 
-  gp_props[PROP_GP_FIT_METHOD] =
-    g_param_spec_uint("fit-method",
-                      NULL, NULL,
-                      G_RECT_FIT_AREA_BEST,
+enum {
+    PROP_BP_0,
+    PROP_WIDTH,
+    PROP_HEIGHT,
+    PROP_RECTS,
+    PROP_ALLOW_ROTATION,
+    PROP_PADDING,
+    PROP_ALIGNMENT,
+    PROP_COUNTING,
+    PROP_BP_LAST
+};
+
+static GParamSpec *bp_props[PROP_BP_LAST] = { NULL, };
+
+G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE(GBinPacker,
+                                    g_bin_packer,
+                                    G_TYPE_OBJECT);
+
+#define BP_GET_PRIV(obj) \
+    ((GBinPackerPrivate *) g_bin_packer_get_instance_private(G_BIN_PACKER(obj)))
+
+/* swap width and height, for placing r turned */
+static inline void
+bp_rect_turn(GRect *r)
+{
+  const guint w = r->width;
+
+  r->width = r->height;
+  r->height = w;
+  r->rotated = !r->rotated;
+}
+
+/* the space r takes up in the packer: its padding added and
+   rounded up to whole blocks of the alignment. Since everything
+   starts at 0, placing only these keeps all positions aligned */
+static inline void
+bp_rect_pad(const GBinPackerPrivate *priv,
+            GRect                   *r)
+{
+  const guint a = priv->alignment;
+
+  r->width = (r->width + priv->padding + a - 1) / a * a;
+  r->height = (r->height + priv->padding + a - 1) / a * a;
+}
+
+static inline gboolean
+bp_padded(const GBinPackerPrivate *priv)
+{
+  return priv->padding > 0 || priv->alignment > 1;
+}
+
+/* whether a has more area than b, for the largest free rect */
+static inline gboolean
+bp_rect_larger(const GRect *a,
+               const GRect *b)
+{
+  return (guint64) a->width * a->height > (guint64) b->width * b->height;
+}
+
+static inline gboolean
+bp_rect_same(const GRect *a,
+             const GRect *b)
+{
+  return a->x == b->x && a->y == b->y &&
+         a->width == b->width && a->height == b->height;
+}
+
+/* the bits of turned, 32 to a word; bits past the last box are 0 */
+static inline gboolean
+bp_turned_get(const GArray *bits,
+              guint         i)
+{
+  return (g_array_index(bits, guint32, i / 32) >> (i % 32)) & 1;
+}
+
+static void
+bp_turned_append(GArray   *bits,
+                 guint     i,
+                 gboolean  turned)
+{
+  if (i % 32 == 0)
+    {
+      g_array_set_size(bits, i / 32 + 1);
+      g_array_index(bits, guint32, i / 32) = 0;
+    }
+
+  g_array_index(bits, guint32, i / 32) |= (guint32) (turned != 0) << (i % 32);
+}
+
+/* drop bit i of n, the last one takes its place */
+static void
+bp_turned_remove(GArray *bits,
+                 guint   i,
+                 guint   n)
+{
+  guint32 *w = (guint32 *) bits->data;
+  const guint last = n - 1;
+  const guint32 bit = (w[last / 32] >> (last % 32)) & 1;
+
+  w[last / 32] &= ~(1u << (last % 32));
+  w[i / 32] = (w[i / 32] & ~(1u << (i % 32))) | (bit << (i % 32));
+
+  g_array_set_size(bits, (n - 1 + 31) / 32);
+}
+
+/* all access to the packed rects goes through these */
+static inline guint
+bp_rects_len(const GBinPackerPrivate *priv)
+{
+  return priv->boxes ? priv->boxes->len : priv->rects->len;
+}
+
+#define BP_SLOT_SHADOWED (1u << 31)
+
+/* ids are hashed as plain numbers; the one id that is the empty key
+   of the map stays out of it */
+#define BP_SLOT_KEY(id) ((guint64) GPOINTER_TO_SIZE(id))
+
+static inline gpointer
+bp_rects_id(const GBinPackerPrivate *priv,
+            guint                    i)
+{
+  if (priv->boxes)
+    return g_array_index(priv->ids, gpointer, i);
+
+  return g_array_index(priv->rects, GRect, i).id;
+}
+
+/* the slot of a rect packed for id other than skip, from the last
+   one down, G_MAXUINT if there is none */
+static guint
+bp_rects_scan(const GBinPackerPrivate *priv,
+              gpointer                 id,
+              guint                    skip)
+{
+  guint i;
+
+  for (i = bp_rects_len(priv); i > 0; i--)
+    if (i - 1 != skip && bp_rects_id(priv, i - 1) == id)
+      return i - 1;
+
+  return G_MAXUINT;
+}
+
+/* the slot of a rect packed for id, G_MAXUINT if there is none */
+static guint
+bp_rects_find(const GBinPackerPrivate *priv,
+              gpointer                 id)
+{
+  const guint64 key = BP_SLOT_KEY(id);
+  guint slot;
+
+  if (key == POS_MAP_EMPTY)
+    return bp_rects_scan(priv, id, G_MAXUINT);
+
+  if (!pos_map_lookup(&priv->slots, key, &slot))
+    return G_MAXUINT;
+
+  return slot & ~BP_SLOT_SHADOWED;
+}
+
+/* the rect for id went to slot */
+static void
+bp_slots_insert(GBinPackerPrivate *priv,
+                gpointer           id,
+                guint              slot)
+{
+  const guint64 key = BP_SLOT_KEY(id);
+  guint old;
+
+  if (key == POS_MAP_EMPTY)
+    return;
+
+  if (pos_map_lookup(&priv->slots, key, &old))
+    slot |= BP_SLOT_SHADOWED;
+
+  pos_map_insert(&priv->slots, key, slot);
+}
+
+/* the rect for id at slot is going away; if it was the one in the
+   map and there were others, the next one found stands in for it,
+   still marked as shadowed in case there are more */
+static void
+bp_slots_remove(GBinPackerPrivate *priv,
+                gpointer           id,
+                guint              slot)
+{
+  const guint64 key = BP_SLOT_KEY(id);
+  guint val, next;
+
+  if (key == POS_MAP_EMPTY ||
+      !pos_map_lookup(&priv->slots, key, &val) ||
+      (val & ~BP_SLOT_SHADOWED) != slot)
+    return;
+
+  next = val & BP_SLOT_SHADOWED ? bp_rects_scan(priv, id, slot) : G_MAXUINT;
+
+  if (next == G_MAXUINT)
+    pos_map_remove(&priv->slots, key);
+  else
+    pos_map_insert(&priv->slots, key, next | BP_SLOT_SHADOWED);
+}
+
+/* the rect for id moved from slot from to slot to */
+static void
+bp_slots_move(GBinPackerPrivate *priv,
+              gpointer           id,
+              guint              from,
+              guint              to)
+{
+  const guint64 key = BP_SLOT_KEY(id);
+  guint val;
+
+  if (key != POS_MAP_EMPTY &&
+      pos_map_lookup(&priv->slots, key, &val) &&
+      (val & ~BP_SLOT_SHADOWED) == from)
+    pos_map_insert(&priv->slots, key, to | (val & BP_SLOT_SHADOWED));
+}
+
+static inline void
+bp_rects_get(const GBinPackerPrivate *priv,
+             guint                    i,
+             GRect                   *r)
+{
+  const BPBox *b;
+
+  if (priv->boxes == NULL)
+    {
+      *r = g_array_index(priv->rects, GRect, i);
+      return;
+    }
+
+  b = &g_array_index(priv->boxes, BPBox, i);
+
+  r->x = b->x;
+  r->y = b->y;
+  r->width = b->width;
+  r->height = b->height;
+  r->rotated = bp_turned_get(priv->turned, i);
+  r->id = g_array_index(priv->ids, gpointer, i);
+}
+
+static void
+bp_rects_append_to(const GBinPackerPrivate *priv,
+                   GArray                  *dst)
+{
+  guint i;
+
+  for (i = 0; i < bp_rects_len(priv); i++)
+    {
+      GRect r;
+
+      bp_rects_get(priv, i, &r);
+      g_array_append_val(dst, r);
+    }
+}
+
+static void
+bp_rects_append(GBinPackerPrivate *priv,
+                const GRect       *r)
+{
+  BPBox b;
+
+  if (priv->boxes &&
+      (r->x > G_MAXUINT16 || r->y > G_MAXUINT16 ||
+       r->width > G_MAXUINT16 || r->height > G_MAXUINT16))
+    {
+      priv->rects = g_array_sized_new(FALSE, FALSE, sizeof(GRect),
+                                      priv->boxes->len + 1);
+      bp_rects_append_to(priv, priv->rects);
+
+      g_array_free(priv->boxes, TRUE);
+      g_array_free(priv->ids, TRUE);
+      g_array_free(priv->turned, TRUE);
+      priv->boxes = priv->ids = priv->turned = NULL;
+    }
+
+  priv->used_area += g_rect_area(r);
+  bp_slots_insert(priv, r->id, bp_rects_len(priv));
+
+  if (priv->boxes == NULL)
+    {
+      g_array_append_vals(priv->rects, r, 1);
+      return;
+    }
+
+  b.x = r->x;
+  b.y = r->y;
+  b.width = r->width;
+  b.height = r->height;
+
+  bp_turned_append(priv->turned, priv->boxes->len, r->rotated);
+  g_array_append_val(priv->boxes, b);
+  g_array_append_vals(priv->ids, &r->id, 1);
+}
+
+/* for the consistency checks: the space each packed rect takes
+   up, with its padding, goes to dst, so that overlaps there also
+   catch missing gutters. Rects that are not aligned go to bad */
+static void
+bp_rects_append_padded(const GBinPackerPrivate  *priv,
+                       GArray                   *dst,
+                       GArray                  **bad)
+{
+  const guint first = dst->len;
+  guint i;
+
+  bp_rects_append_to(priv, dst);
+
+  for (i = first; i < dst->len; i++)
+    {
+      GRect *r = &g_array_index(dst, GRect, i);
+
+      if (r->x % priv->alignment != 0 || r->y % priv->alignment != 0)
+        {
+          if (*bad == NULL)
+            *bad = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+
+          g_array_append_vals(*bad, r, 1);
+        }
+
+      bp_rect_pad(priv, r);
+    }
+}
+
+/* give the packed rect i the size of r, never larger than before */
+static void
+bp_rects_set_size(GBinPackerPrivate *priv,
+                  guint              i,
+                  const GRect       *r)
+{
+  if (priv->boxes)
+    {
+      BPBox *b = &g_array_index(priv->boxes, BPBox, i);
+
+      priv->used_area -= (guint) b->width * b->height;
+      b->width = r->width;
+      b->height = r->height;
+    }
+  else
+    {
+      GRect *t = &g_array_index(priv->rects, GRect, i);
+
+      priv->used_area -= g_rect_area(t);
+      t->width = r->width;
+      t->height = r->height;
+    }
+
+  priv->used_area += g_rect_area(r);
+}
+
+/* the last rect moves into the hole, so the slots are in the
+   order of placement only until something is removed */
+static void
+bp_rects_remove(GBinPackerPrivate *priv,
+                guint              i)
+{
+  const guint last = bp_rects_len(priv) - 1;
+
+  bp_slots_remove(priv, bp_rects_id(priv, i), i);
+
+  if (i != last)
+    bp_slots_move(priv, bp_rects_id(priv, last), last, i);
+
+  if (priv->boxes)
+    {
+      const BPBox *b = &g_array_index(priv->boxes, BPBox, i);
+
+      priv->used_area -= (guint) b->width * b->height;
+      bp_turned_remove(priv->turned, i, priv->boxes->len);
+      g_array_remove_index_fast(priv->boxes, i);
+      g_array_remove_index_fast(priv->ids, i);
+    }
+  else
+    {
+      priv->used_area -= g_rect_area(&g_array_index(priv->rects, GRect, i));
+      g_array_remove_index_fast(priv->rects, i);
+    }
+}
+
+static void
+g_bin_packer_finalize(GObject *object)
+{
+    GBinPacker *bp = G_BIN_PACKER(object);
+    GBinPackerPrivate *priv = BP_GET_PRIV(bp);
+
+    if (priv->boxes)
+      {
+        g_array_free(priv->boxes, TRUE);
+        g_array_free(priv->ids, TRUE);
+        g_array_free(priv->turned, TRUE);
+      }
+    else
+      g_array_free(priv->rects, TRUE);
+
+    pos_map_clear(&priv->slots);
+
+    if (priv->counting)
+      g_free(priv->counters);
+}
+
+static void
+g_bin_packer_get_property(GObject    *object,
+			  guint       prop_id,
+			  GValue     *value,
+			  GParamSpec *pspec)
+{
+  GBinPacker *bp = G_BIN_PACKER(object);
+  GBinPackerPrivate *priv = BP_GET_PRIV(bp);
+
+  switch (prop_id) {
+
+  case PROP_WIDTH:
+    g_value_set_uint(value, priv->width);
+    break;
+
+  case PROP_HEIGHT:
+    g_value_set_uint(value, priv->height);
+    break;
+
+  case PROP_RECTS:
+    {
+      GArray *rects = g_array_sized_new(FALSE, FALSE, sizeof(GRect),
+                                        bp_rects_len(priv));
+
+      bp_rects_append_to(priv, rects);
+      g_value_take_boxed(value, rects);
+    }
+    break;
+
+  case PROP_ALLOW_ROTATION:
+    g_value_set_boolean(value, priv->allow_rotation);
+    break;
+
+  case PROP_PADDING:
+    g_value_set_uint(value, priv->padding);
+    break;
+
+  case PROP_ALIGNMENT:
+    g_value_set_uint(value, priv->alignment);
+    break;
+
+  case PROP_COUNTING:
+    g_value_set_boolean(value, priv->counting);
+    break;
+  }
+
+}
+
+static void
+g_bin_packer_set_property(GObject     *object,
+			  guint        prop_id,
+			  const GValue *value,
+			  GParamSpec   *pspec)
+{
+    GBinPacker *bp = G_BIN_PACKER(object);
+    GBinPackerPrivate *priv = BP_GET_PRIV(bp);
+
+    switch (prop_id) {
+
+    case PROP_WIDTH:
+      priv->width = g_value_get_uint(value);
+      break;
+
+    case PROP_HEIGHT:
+      priv->height = g_value_get_uint(value);
+      break;
+
+    case PROP_ALLOW_ROTATION:
+      priv->allow_rotation = g_value_get_boolean(value);
+      break;
+
+    case PROP_PADDING:
+      priv->padding = g_value_get_uint(value);
+      break;
+
+    case PROP_ALIGNMENT:
+      priv->alignment = g_value_get_uint(value);
+      break;
+
+    case PROP_COUNTING:
+      priv->counting = g_value_get_boolean(value);
+      if (priv->counting)
+        priv->counters = g_new0(GBinPackerCounters, 1);
+      break;
+    }
+}
+
+
+
+static void
+g_bin_packer_class_init(GBinPackerClass *klass)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+    gobject_class->finalize     = g_bin_packer_finalize;
+    gobject_class->get_property = g_bin_packer_get_property;
+    gobject_class->set_property = g_bin_packer_set_property;
+
+    bp_props[PROP_WIDTH] =
+      g_param_spec_uint("width",
+			NULL, NULL,
+			0, G_MAXUINT, 0,
+			G_PARAM_CONSTRUCT_ONLY |
+			G_PARAM_READWRITE |
+			G_PARAM_STATIC_NICK);
+
+    bp_props[PROP_HEIGHT] =
+      g_param_spec_uint("height",
+			NULL, NULL,
+			0, G_MAXUINT, 0,
+			G_PARAM_CONSTRUCT_ONLY |
+			G_PARAM_READWRITE |
+			G_PARAM_STATIC_NICK);
+
+    bp_props[PROP_RECTS] =
+      g_param_spec_boxed("rects",
+			 NULL, NULL,
+			 G_TYPE_ARRAY,
+			 G_PARAM_READWRITE |
+			 G_PARAM_STATIC_NICK);
+
+    /* bins may be placed turned by 90° if that fits better */
+    bp_props[PROP_ALLOW_ROTATION] =
+      g_param_spec_boolean("allow-rotation",
+                           NULL, NULL,
+                           FALSE,
+                           G_PARAM_CONSTRUCT_ONLY |
+                           G_PARAM_READWRITE |
+                           G_PARAM_STATIC_NICK);
+
+    /* a gutter of that many pixels right of and below every rect,
+       for filtering; the packed rects keep their own size */
+    bp_props[PROP_PADDING] =
+      g_param_spec_uint("padding",
+                        NULL, NULL,
+                        0, G_MAXUINT16, 0,
+                        G_PARAM_CONSTRUCT_ONLY |
+                        G_PARAM_READWRITE |
+                        G_PARAM_STATIC_NICK);
+
+    /* every rect starts at multiples of it in x and y, e.g. 4 for
+       block compressed atlases; growing the packer needs its size
+       to be a multiple of it as well */
+    bp_props[PROP_ALIGNMENT] =
+      g_param_spec_uint("alignment",
+                        NULL, NULL,
+                        1, G_MAXUINT16, 1,
+                        G_PARAM_CONSTRUCT_ONLY |
+                        G_PARAM_READWRITE |
+                        G_PARAM_STATIC_NICK);
+
+    /* keep the counters of g_bin_packer_get_counters(), off
+       it costs a single branch where they would be counted */
+    bp_props[PROP_COUNTING] =
+      g_param_spec_boolean("counting",
+                           NULL, NULL,
+                           FALSE,
+                           G_PARAM_CONSTRUCT_ONLY |
+                           G_PARAM_READWRITE |
+                           G_PARAM_STATIC_NICK);
+
+    g_object_class_install_properties(gobject_class,
+                                      PROP_BP_LAST,
+                                      bp_props);
+}
+
+static void
+g_bin_packer_init(GBinPacker *bp)
+{
+  GBinPackerPrivate *priv = BP_GET_PRIV(bp);
+
+  priv->boxes = g_array_new(FALSE, FALSE, sizeof(BPBox));
+  priv->ids = g_array_new(FALSE, FALSE, sizeof(gpointer));
+  priv->turned = g_array_new(FALSE, FALSE, sizeof(guint32));
+  pos_map_init(&priv->slots, 64);
+  priv->alignment = 1;
+}
+
+gfloat g_bin_packer_occupancy(GBinPacker *packer)
+{
+  GBinPackerPrivate *priv = BP_GET_PRIV(packer);
+  gdouble total;
+
+  total = priv->height * priv->width;
+  return priv->used_area / total;
+}
+
+void
+g_bin_packer_get_stats(GBinPacker      *packer,
+                       GBinPackerStats *stats)
+{
+  GBinPackerClass *klass = G_BIN_PACKER_GET_CLASS(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(packer);
+
+  memset(stats, 0, sizeof(GBinPackerStats));
+  stats->used_area = priv->used_area;
+
+  if (klass->stats)
+    klass->stats(packer, stats);
+}
+
+/* all zero for a packer that is not "counting" */
+void
+g_bin_packer_get_counters(GBinPacker         *packer,
+                          GBinPackerCounters *counters)
+{
+  GBinPackerPrivate *priv = BP_GET_PRIV(packer);
+
+  if (priv->counters)
+    *counters = *priv->counters;
+  else
+    memset(counters, 0, sizeof(GBinPackerCounters));
+}
+
+void
+g_bin_packer_reset_counters(GBinPacker *packer)
+{
+  GBinPackerPrivate *priv = BP_GET_PRIV(packer);
+
+  if (priv->counters)
+    memset(priv->counters, 0, sizeof(GBinPackerCounters));
+}
+
+/* func is called before and after every batch of rects that gets
+   placed, by g_bin_packer_insert() and g_bin_packer_place() and
+   the inserts of the packers; NULL turns it off again */
+void
+g_bin_packer_set_trace_func(GBinPacker          *packer,
+                            GBinPackerTraceFunc  func,
+                            gpointer             user_data)
+{
+  GBinPackerPrivate *priv = BP_GET_PRIV(packer);
+
+  priv->trace = func;
+  priv->trace_data = user_data;
+}
+
+/* give the space of the rect that was packed for id back to the
+   packer; what exactly happens to it is up to the subclass. The
+   rect is found through a map from the ids; if several were packed
+   for the same id, which one goes is not defined and all but the
+   first of them take a scan over the packed rects */
+gboolean
+g_bin_packer_remove(GBinPacker *packer,
+                    gpointer    id)
+{
+  GBinPackerClass *klass = G_BIN_PACKER_GET_CLASS(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(packer);
+  const guint i = bp_rects_find(priv, id);
+  GRect r;
+
+  if (i == G_MAXUINT)
+    return FALSE;
+
+  bp_rects_get(priv, i, &r);
+  bp_rects_remove(priv, i);
+  bp_rect_pad(priv, &r);
+
+  if (klass->release)
+    klass->release(packer, &r);
+
+  return TRUE;
+}
+
+/* klass->place for the padded rects, which then get their own
+   size back, turned along with them if they were */
+static guint
+bp_place(GBinPacker *packer,
+         GRect      *rects,
+         guint       n_rects,
+         guint      *order)
+{
+  GBinPackerClass *klass = G_BIN_PACKER_GET_CLASS(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(packer);
+  const guint first = bp_rects_len(priv);
+  guint *sizes = NULL;
+  guint i, n_placed;
+
+  if (G_UNLIKELY(priv->trace != NULL))
+    priv->trace(packer, G_BIN_PACKER_TRACE_BEGIN, n_rects, priv->trace_data);
+
+  if (bp_padded(priv))
+    {
+      sizes = g_new(guint, 2 * n_rects);
+
+      for (i = 0; i < n_rects; i++)
+        {
+          sizes[2 * i] = rects[i].width;
+          sizes[2 * i + 1] = rects[i].height;
+          bp_rect_pad(priv, &rects[i]);
+        }
+    }
+
+  n_placed = klass->place(packer, rects, n_rects, order);
+
+  if (sizes)
+    {
+      for (i = 0; i < n_rects; i++)
+        {
+          const gboolean turned = rects[i].rotated;
+
+          rects[i].width = sizes[2 * i + turned];
+          rects[i].height = sizes[2 * i + !turned];
+        }
+
+      /* the packed ones were appended in the order they were placed */
+      for (i = 0; i < n_placed; i++)
+        bp_rects_set_size(priv, first + i, &rects[order[i]]);
+
+      g_free(sizes);
+    }
+
+  BP_COUNT(priv, failed, n_rects - n_placed);
+
+  if (G_UNLIKELY(priv->trace != NULL))
+    priv->trace(packer, G_BIN_PACKER_TRACE_END, n_placed, priv->trace_data);
+
+  return n_placed;
+}
+
+/* the same for a single rect */
+static gboolean
+bp_pack(GBinPacker *packer,
+        GRect      *r)
+{
+  GBinPackerClass *klass = G_BIN_PACKER_GET_CLASS(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(packer);
+  const guint width = r->width;
+  const guint height = r->height;
+  gboolean packed;
+
+  if (!bp_padded(priv))
+    {
+      packed = klass->pack(packer, r);
+      BP_COUNT(priv, failed, !packed);
+      return packed;
+    }
+
+  bp_rect_pad(priv, r);
+  packed = klass->pack(packer, r);
+
+  r->width = r->rotated ? height : width;
+  r->height = r->rotated ? width : height;
+
+  if (packed)
+    bp_rects_set_size(priv, bp_rects_len(priv) - 1, r);
+
+  BP_COUNT(priv, failed, !packed);
+
+  return packed;
+}
+
+/* the GArray flavour of place(): the packed bins move from bins to
+   the returned array in the order they were placed, the rest stay
+   behind in their order */
+static GArray *
+bp_insert(GBinPacker *packer,
+          GArray     *bins)
+{
+  const guint n = bins->len;
+  GRect *rects;
+  guint *order;
+  guint i, n_placed, left = 0;
+  GArray *out;
+
+  rects = g_new(GRect, n);
+  order = g_new(guint, n);
+
+  for (i = 0; i < n; i++)
+    {
+      rects[i] = g_array_index(bins, GRect, i);
+      rects[i].x = rects[i].y = G_RECT_UNPLACED;
+      rects[i].rotated = FALSE;
+    }
+
+  n_placed = bp_place(packer, rects, n, order);
+
+  out = g_array_sized_new(FALSE, FALSE, sizeof(GRect), n_placed);
+
+  for (i = 0; i < n_placed; i++)
+    g_array_append_val(out, rects[order[i]]);
+
+  for (i = 0; i < n; i++)
+    if (rects[i].x == G_RECT_UNPLACED)
+      g_array_index(bins, GRect, left++) = g_array_index(bins, GRect, i);
+
+  g_array_set_size(bins, left);
+
+  g_free(order);
+  g_free(rects);
+
+  return out;
+}
+
+/* pack as many of n_bins bins as possible without touching them:
+   placed[i] is bins[i] with its position, or at G_RECT_UNPLACED
+   if it did not fit. placed may be bins itself. Returns the number
+   of bins packed */
+guint
+g_bin_packer_place(GBinPacker  *packer,
+                   const GRect *bins,
+                   guint        n_bins,
+                   GRect       *placed)
+{
+  GBinPackerClass *klass = G_BIN_PACKER_GET_CLASS(packer);
+  guint *order;
+  guint i, n_placed;
+
+  g_return_val_if_fail(klass->place != NULL, 0);
+
+  for (i = 0; i < n_bins; i++)
+    {
+      placed[i] = bins[i];
+      placed[i].x = placed[i].y = G_RECT_UNPLACED;
+      placed[i].rotated = FALSE;
+    }
+
+  order = g_new(guint, n_bins);
+  n_placed = bp_place(packer, placed, n_bins, order);
+  g_free(order);
+
+  return n_placed;
+}
+
+/* pack as many of the bins as possible, the packed ones are
+   removed from bins and returned with their position */
+GArray *
+g_bin_packer_insert(GBinPacker *packer,
+                    GArray     *bins)
+{
+  GBinPackerClass *klass = G_BIN_PACKER_GET_CLASS(packer);
+
+  g_return_val_if_fail(klass->insert != NULL, NULL);
+
+  return klass->insert(packer, bins);
+}
+
+/* place a single rect without going through a GArray, r gets its
+   position on success and is left at G_RECT_UNPLACED otherwise */
+gboolean
+g_bin_packer_pack(GBinPacker *packer,
+                  GRect      *r)
+{
+  GBinPackerClass *klass = G_BIN_PACKER_GET_CLASS(packer);
+
+  g_return_val_if_fail(klass->pack != NULL, FALSE);
+
+  return bp_pack(packer, r);
+}
+
+/* make the packer bigger, keeping all the packed rects where
+   they are; it can not shrink */
+gboolean
+g_bin_packer_grow(GBinPacker *packer,
+                  guint       width,
+                  guint       height)
+{
+  GBinPackerClass *klass = G_BIN_PACKER_GET_CLASS(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(packer);
+  const guint old_width = priv->width;
+  const guint old_height = priv->height;
+
+  if (width < old_width || height < old_height)
+    return FALSE;
+
+  if (width == old_width && height == old_height)
+    return TRUE;
+
+  /* the new space has to start on a block boundary */
+  if (old_width % priv->alignment != 0 || old_height % priv->alignment != 0)
+    return FALSE;
+
+  priv->width = width;
+  priv->height = height;
+
+  if (klass->grow)
+    klass->grow(packer, old_width, old_height);
+
+  if (width != old_width)
+    g_object_notify_by_pspec(G_OBJECT(packer), bp_props[PROP_WIDTH]);
+
+  if (height != old_height)
+    g_object_notify_by_pspec(G_OBJECT(packer), bp_props[PROP_HEIGHT]);
+
+  return TRUE;
+}
+
+/* ************************************************************************** */
+
+/* snapshots are a flat little endian stream of 32 bit words:
+   a header with the kind of packer and its construct properties,
+   the packed rects and then whatever state the subclass needs.
+   The version goes up with any change to the layout */
+#define BP_SNAPSHOT_MAGIC   "GBPS"
+#define BP_SNAPSHOT_VERSION 2
+
+G_DEFINE_QUARK(g-bin-packer-error-quark, g_bin_packer_error)
+
+static void
+bp_write_u32(GByteArray *out,
+             guint32     v)
+{
+  v = GUINT32_TO_LE(v);
+  g_byte_array_append(out, (const guint8 *) &v, sizeof(v));
+}
+
+static void
+bp_write_u64(GByteArray *out,
+             guint64     v)
+{
+  v = GUINT64_TO_LE(v);
+  g_byte_array_append(out, (const guint8 *) &v, sizeof(v));
+}
+
+static gboolean
+bp_read_u32(const guint8 **data,
+            gsize         *size,
+            guint32       *v)
+{
+  if (*size < sizeof(*v))
+    return FALSE;
+
+  memcpy(v, *data, sizeof(*v));
+  *v = GUINT32_FROM_LE(*v);
+
+  *data += sizeof(*v);
+  *size -= sizeof(*v);
+
+  return TRUE;
+}
+
+static gboolean
+bp_read_u64(const guint8 **data,
+            gsize         *size,
+            guint64       *v)
+{
+  if (*size < sizeof(*v))
+    return FALSE;
+
+  memcpy(v, *data, sizeof(*v));
+  *v = GUINT64_FROM_LE(*v);
+
+  *data += sizeof(*v);
+  *size -= sizeof(*v);
+
+  return TRUE;
+}
+
+/* a count of items of at least item_size bytes each, which have
+   to be there for it to be believed */
+static gboolean
+bp_read_count(const guint8 **data,
+              gsize         *size,
+              gsize          item_size,
+              guint32       *n)
+{
+  return bp_read_u32(data, size, n) && *n <= *size / item_size;
+}
+
+/* position and size only, for free rects and the like */
+static void
+bp_write_rects(GByteArray   *out,
+               const GArray *rects)
+{
+  guint i;
+
+  bp_write_u32(out, rects->len);
+
+  for (i = 0; i < rects->len; i++)
+    {
+      const GRect *r = &g_array_index(rects, GRect, i);
+
+      bp_write_u32(out, r->x);
+      bp_write_u32(out, r->y);
+      bp_write_u32(out, r->width);
+      bp_write_u32(out, r->height);
+    }
+}
+
+static gboolean
+bp_read_rects(const guint8 **data,
+              gsize         *size,
+              GArray        *rects)
+{
+  guint32 n, i;
+
+  if (!bp_read_count(data, size, 4 * sizeof(guint32), &n))
+    return FALSE;
+
+  g_array_set_size(rects, n);
+
+  for (i = 0; i < n; i++)
+    {
+      GRect *r = &g_array_index(rects, GRect, i);
+      guint32 v[4] = {0, };
+
+      bp_read_u32(data, size, &v[0]);
+      bp_read_u32(data, size, &v[1]);
+      bp_read_u32(data, size, &v[2]);
+      bp_read_u32(data, size, &v[3]);
+
+      memset(r, 0, sizeof(*r));
+      r->x = v[0];
+      r->y = v[1];
+      r->width = v[2];
+      r->height = v[3];
+    }
+
+  return TRUE;
+}
+
+/* nonzero and inside the atlas, without x + width or y + height
+   wrapping around; anything read from a snapshot has to be */
+static gboolean
+bp_rect_inside(const GBinPackerPrivate *priv,
+               const GRect             *r)
+{
+  return g_rect_area_nonzero(r) &&
+         r->x <= priv->width  && r->width  <= priv->width  - r->x &&
+         r->y <= priv->height && r->height <= priv->height - r->y;
+}
+
+static gboolean
+bp_rects_inside(const GBinPackerPrivate *priv,
+                const GArray            *rects)
+{
+  guint i;
+
+  for (i = 0; i < rects->len; i++)
+    if (!bp_rect_inside(priv, &g_array_index(rects, GRect, i)))
+      return FALSE;
+
+  return TRUE;
+}
+
+/* the packed rects; ids are kept as plain numbers, so they only
+   survive a restart if they are numbers (GUINT_TO_POINTER) */
+static void
+bp_write_packed(const GBinPackerPrivate *priv,
+                GByteArray              *out)
+{
+  guint i;
+
+  bp_write_u32(out, bp_rects_len(priv));
+
+  for (i = 0; i < bp_rects_len(priv); i++)
+    {
+      GRect r;
+
+      bp_rects_get(priv, i, &r);
+
+      bp_write_u32(out, r.x);
+      bp_write_u32(out, r.y);
+      bp_write_u32(out, r.width);
+      bp_write_u32(out, r.height);
+      bp_write_u32(out, r.rotated);
+      bp_write_u64(out, GPOINTER_TO_SIZE(r.id));
+    }
+}
+
+static gboolean
+bp_read_packed(GBinPackerPrivate  *priv,
+               const guint8      **data,
+               gsize              *size)
+{
+  guint32 n, i;
+
+  if (!bp_read_count(data, size, 5 * sizeof(guint32) + sizeof(guint64), &n))
+    return FALSE;
+
+  for (i = 0; i < n; i++)
+    {
+      GRect r = {0, };
+      guint32 v[5] = {0, };
+      guint64 id = 0;
+
+      bp_read_u32(data, size, &v[0]);
+      bp_read_u32(data, size, &v[1]);
+      bp_read_u32(data, size, &v[2]);
+      bp_read_u32(data, size, &v[3]);
+      bp_read_u32(data, size, &v[4]);
+      bp_read_u64(data, size, &id);
+
+      r.x = v[0];
+      r.y = v[1];
+      r.width = v[2];
+      r.height = v[3];
+      r.rotated = v[4] != 0;
+      r.id = GSIZE_TO_POINTER(id);
+
+      if (!bp_rect_inside(priv, &r))
+        return FALSE;
+
+      bp_rects_append(priv, &r);
+    }
+
+  return TRUE;
+}
+
+/* the construct properties recreate everything but the state */
+static gboolean
+bp_snapshot_prop(const GParamSpec *pspec)
+{
+  const GType type = G_PARAM_SPEC_VALUE_TYPE(pspec);
+
+  return (pspec->flags & G_PARAM_CONSTRUCT_ONLY) &&
+         (type == G_TYPE_UINT || type == G_TYPE_BOOLEAN);
+}
+
+static GType
+bp_snapshot_type(guint32 kind)
+{
+  switch (kind)
+    {
+    case 1: return G_TYPE_GUILLOTINE_PACKER;
+    case 2: return G_TYPE_SKYLINE_PACKER;
+    case 3: return G_TYPE_MAX_RECTS_PACKER;
+    case 4: return G_TYPE_SHELF_PACKER;
+    default: return G_TYPE_INVALID;
+    }
+}
+
+/* the complete state of packer, for g_bin_packer_load() to pick
+   up where it left off without placing anything again */
+GBytes *
+g_bin_packer_save(GBinPacker *packer)
+{
+  GBinPackerClass *klass = G_BIN_PACKER_GET_CLASS(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(packer);
+  GParamSpec **props;
+  GByteArray *out;
+  guint32 kind = 1;
+  guint n_props, n = 0, i;
+
+  while (bp_snapshot_type(kind) != G_TYPE_INVALID &&
+         bp_snapshot_type(kind) != G_OBJECT_TYPE(packer))
+    kind++;
+
+  g_return_val_if_fail(bp_snapshot_type(kind) != G_TYPE_INVALID, NULL);
+  g_return_val_if_fail(klass->save != NULL, NULL);
+
+  out = g_byte_array_new();
+  g_byte_array_append(out, (const guint8 *) BP_SNAPSHOT_MAGIC, 4);
+  bp_write_u32(out, BP_SNAPSHOT_VERSION);
+  bp_write_u32(out, kind);
+
+  props = g_object_class_list_properties(G_OBJECT_GET_CLASS(packer), &n_props);
+
+  for (i = 0; i < n_props; i++)
+    n += bp_snapshot_prop(props[i]);
+
+  bp_write_u32(out, n);
+
+  for (i = 0; i < n_props; i++)
+    {
+      const gsize len = strlen(props[i]->name);
+      GValue value = G_VALUE_INIT;
+
+      if (!bp_snapshot_prop(props[i]))
+        continue;
+
+      g_value_init(&value, G_PARAM_SPEC_VALUE_TYPE(props[i]));
+      g_object_get_property(G_OBJECT(packer), props[i]->name, &value);
+
+      bp_write_u32(out, len);
+      g_byte_array_append(out, (const guint8 *) props[i]->name, len);
+
+      if (G_VALUE_HOLDS_BOOLEAN(&value))
+        bp_write_u32(out, g_value_get_boolean(&value));
+      else
+        bp_write_u32(out, g_value_get_uint(&value));
+
+      g_value_unset(&value);
+    }
+
+  g_free(props);
+
+  bp_write_packed(priv, out);
+  klass->save(packer, out);
+
+  return g_byte_array_free_to_bytes(out);
+}
+
+/* a new packer from a snapshot made by g_bin_packer_save(); bytes
+   may well be a mapped file, nothing is placed again */
+GBinPacker *
+g_bin_packer_load(GBytes  *bytes,
+                  GError **error)
+{
+  gsize size;
+  const guint8 *data = g_bytes_get_data(bytes, &size);
+  GObjectClass *klass = NULL;
+  GBinPacker *packer = NULL;
+  const char **names = NULL;
+  GValue *values = NULL;
+  GArray *bad;
+  guint32 version, kind, n = 0, i;
+  GType type;
+
+  if (size < 4 || memcmp(data, BP_SNAPSHOT_MAGIC, 4) != 0)
+    goto invalid;
+
+  data += 4;
+  size -= 4;
+
+  if (!bp_read_u32(&data, &size, &version))
+    goto invalid;
+
+  if (version != BP_SNAPSHOT_VERSION)
+    {
+      g_set_error(error, G_BIN_PACKER_ERROR, G_BIN_PACKER_ERROR_VERSION,
+                  "snapshot version %u, expected %u",
+                  version, BP_SNAPSHOT_VERSION);
+      return NULL;
+    }
+
+  if (!bp_read_u32(&data, &size, &kind) ||
+      (type = bp_snapshot_type(kind)) == G_TYPE_INVALID ||
+      !bp_read_count(&data, &size, 2 * sizeof(guint32), &n))
+    goto invalid;
+
+  klass = g_type_class_ref(type);
+  names = g_new0(const char *, n);
+  values = g_new0(GValue, n);
+
+  for (i = 0; i < n; i++)
+    {
+      GParamSpec *pspec;
+      guint32 len, v;
+      char *name;
+
+      if (!bp_read_count(&data, &size, 1, &len))
+        goto invalid;
+
+      name = g_strndup((const char *) data, len);
+      names[i] = name;
+      data += len;
+      size -= len;
+
+      pspec = g_object_class_find_property(klass, name);
+
+      if (pspec == NULL || !bp_snapshot_prop(pspec) ||
+          !bp_read_u32(&data, &size, &v))
+        goto invalid;
+
+      g_value_init(&values[i], G_PARAM_SPEC_VALUE_TYPE(pspec));
+
+      if (G_VALUE_HOLDS_BOOLEAN(&values[i]))
+        g_value_set_boolean(&values[i], v != 0);
+      else
+        g_value_set_uint(&values[i], v);
+
+      if (g_param_value_validate(pspec, &values[i]))
+        goto invalid;
+    }
+
+  packer = g_object_new_with_properties(type, n, names, values);
+
+  if (!bp_read_packed(BP_GET_PRIV(packer), &data, &size) ||
+      !G_BIN_PACKER_GET_CLASS(packer)->load(packer, &data, &size) ||
+      size != 0)
+    {
+      g_clear_object(&packer);
+      goto invalid;
+    }
+
+  /* every rect is in bounds by now, but nothing may overlap either */
+  bad = g_bin_packer_check(packer);
+  if (bad != NULL)
+    {
+      g_array_free(bad, TRUE);
+      g_clear_object(&packer);
+      goto invalid;
+    }
+
+  goto out;
+
+ invalid:
+  g_set_error_literal(error, G_BIN_PACKER_ERROR, G_BIN_PACKER_ERROR_INVALID,
+                      "not a valid bin packer snapshot");
+
+ out:
+  for (i = 0; i < n && values; i++)
+    {
+      g_free((char *) names[i]);
+
+      if (G_IS_VALUE(&values[i]))
+        g_value_unset(&values[i]);
+    }
+
+  g_free(names);
+  g_free(values);
+
+  if (klass)
+    g_type_class_unref(klass);
+
+  return packer;
+}
+
+/* ************************************************************************** */
+
+/* g_bin_packer_check() sweeps a line over x. The rects it crosses
+   are kept in two interval trees over y, one for the packed rects
+   and one for the free ones, so every rect entering the line only
+   meets the ones it actually overlaps: O(n log n + overlaps) */
+
+typedef struct BPSweepEvent {
+  guint x;
+  guint enter;  /* leaving sorts first, touching is no overlap */
+  guint idx;
+} BPSweepEvent;
+
+/* the trees have a fixed shape, a balanced tree over all the
+   intervals sorted by start; max is the largest end of the active
+   intervals below a node, 0 for none */
+typedef struct BPInterval {
+  guint start;
+  guint end;
+  guint idx;
+  guint active;
+  guint max;
+} BPInterval;
+
+static gint
+bp_sweep_event_cmp(gconstpointer a,
+                   gconstpointer b)
+{
+  const BPSweepEvent *ea = a;
+  const BPSweepEvent *eb = b;
+
+  if (ea->x != eb->x)
+    return ea->x < eb->x ? -1 : 1;
+
+  return (gint) ea->enter - (gint) eb->enter;
+}
+
+static gint
+bp_interval_cmp(gconstpointer a,
+                gconstpointer b)
+{
+  const BPInterval *ia = a;
+  const BPInterval *ib = b;
+
+  if (ia->start != ib->start)
+    return ia->start < ib->start ? -1 : 1;
+
+  return ia->idx < ib->idx ? -1 : ia->idx > ib->idx;
+}
+
+static inline guint
+bp_itree_max(const BPInterval *t,
+             guint             lo,
+             guint             hi)
+{
+  return lo < hi ? t[lo + (hi - lo) / 2].max : 0;
+}
+
+/* flip the node at p and fix max on the way back up */
+static void
+bp_itree_update(BPInterval *t,
+                guint       lo,
+                guint       hi,
+                guint       p)
+{
+  const guint mid = lo + (hi - lo) / 2;
+  guint m;
+
+  if (p < mid)
+    bp_itree_update(t, lo, mid, p);
+  else if (p > mid)
+    bp_itree_update(t, mid + 1, hi, p);
+
+  m = t[mid].active ? t[mid].end : 0;
+  m = MAX(m, bp_itree_max(t, lo, mid));
+  m = MAX(m, bp_itree_max(t, mid + 1, hi));
+  t[mid].max = m;
+}
+
+/* the active intervals overlapping [y0, y1) go to hits */
+static void
+bp_itree_query(const BPInterval *t,
+               guint             lo,
+               guint             hi,
+               guint             y0,
+               guint             y1,
+               GArray           *hits)
+{
+  while (lo < hi)
+    {
+      const guint mid = lo + (hi - lo) / 2;
+
+      if (t[mid].max <= y0)
+        return;
+
+      bp_itree_query(t, lo, mid, y0, y1, hits);
+
+      /* everything right of mid starts at or after it */
+      if (t[mid].start >= y1)
+        return;
+
+      if (t[mid].active && t[mid].end > y0)
+        g_array_append_val(hits, t[mid].idx);
+
+      lo = mid + 1;
+    }
+}
+
+static void
+bp_check_fail(GArray      **bad,
+              const GRect  *r)
+{
+  if (*bad == NULL)
+    *bad = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+
+  g_array_append_vals(*bad, r, 1);
+}
+
+/* the packed rects, with their padding, must lie inside the packer
+   and overlap neither each other nor any free rect the subclass
+   keeps; the intersections and the rects out of bounds or off the
+   alignment are returned, NULL if there are none */
+GArray *
+g_bin_packer_check(GBinPacker *packer)
+{
+  GBinPackerClass *klass = G_BIN_PACKER_GET_CLASS(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(packer);
+  GArray *bad = NULL;
+  GArray *all, *events, *hits;
+  GArray *trees[2];
+  gboolean disjoint = TRUE;
+  guint n_used, n;
+  guint *pos;
+  guint i, k;
+
+  all = g_array_sized_new(FALSE, FALSE, sizeof(GRect), bp_rects_len(priv));
+  bp_rects_append_padded(priv, all, &bad);
+  n_used = all->len;
+
+  if (klass->free_space)
+    disjoint = klass->free_space(packer, all);
+
+  n = all->len;
+  events = g_array_sized_new(FALSE, FALSE, sizeof(BPSweepEvent), 2 * n);
+  trees[0] = g_array_sized_new(FALSE, FALSE, sizeof(BPInterval), n_used);
+  trees[1] = g_array_sized_new(FALSE, FALSE, sizeof(BPInterval), n - n_used);
+
+  for (i = 0; i < n; i++)
+    {
+      const GRect *r = &g_array_index(all, GRect, i);
+      BPSweepEvent e = {r->x, TRUE, i};
+      BPInterval iv = {r->y, r->y + r->height, i, FALSE, 0};
+
+      if (r->x + r->width > priv->width || r->y + r->height > priv->height)
+        bp_check_fail(&bad, r);
+
+      if (!g_rect_area_nonzero(r))
+        continue;
+
+      g_array_append_val(events, e);
+      e.x = r->x + r->width;
+      e.enter = FALSE;
+      g_array_append_val(events, e);
+
+      g_array_append_val(trees[i >= n_used], iv);
+    }
+
+  g_array_sort(events, bp_sweep_event_cmp);
+
+  pos = g_new(guint, n);
+  for (k = 0; k < 2; k++)
+    {
+      g_array_sort(trees[k], bp_interval_cmp);
+
+      for (i = 0; i < trees[k]->len; i++)
+        pos[g_array_index(trees[k], BPInterval, i).idx] = i;
+    }
+
+  hits = g_array_new(FALSE, FALSE, sizeof(guint));
+
+  for (i = 0; i < events->len; i++)
+    {
+      const BPSweepEvent *e = &g_array_index(events, BPSweepEvent, i);
+      const GRect *r = &g_array_index(all, GRect, e->idx);
+      const guint in_free = e->idx >= n_used;
+      BPInterval *t = (BPInterval *) trees[in_free]->data;
+
+      /* a packed rect must not meet anything, a free one only
+         has to stay clear of the other free ones if they are
+         disjoint to begin with */
+      if (e->enter)
+        {
+          g_array_set_size(hits, 0);
+          bp_itree_query((BPInterval *) trees[0]->data, 0, trees[0]->len,
+                         r->y, r->y + r->height, hits);
+
+          if (!in_free || disjoint)
+            bp_itree_query((BPInterval *) trees[1]->data, 0, trees[1]->len,
+                           r->y, r->y + r->height, hits);
+
+          for (k = 0; k < hits->len; k++)
+            {
+              const GRect *o = &g_array_index(all, GRect,
+                                              g_array_index(hits, guint, k));
+              GRect is = {0, };
+
+              if (g_rect_intersect(r, o, &is))
+                bp_check_fail(&bad, &is);
+            }
+        }
+
+      t[pos[e->idx]].active = e->enter;
+      bp_itree_update(t, 0, trees[in_free]->len, pos[e->idx]);
+    }
+
+  g_array_free(hits, TRUE);
+  g_free(pos);
+  g_array_free(trees[0], TRUE);
+  g_array_free(trees[1], TRUE);
+  g_array_free(events, TRUE);
+  g_array_free(all, TRUE);
+
+  return bad;
+}
+
+/* below this many free rects a linear scan beats the index */
+#define GP_INDEX_MIN_FREE 64
+
+typedef struct FreeKey {
+  guint major;
+  guint minor;
+  guint pos;         /* index into rects_free */
+} FreeKey;
+
+/* a sorted sequence of FreeKeys, ordered by (major, minor, pos).
+   It is kept as a list of small sorted chunks, so that inserting
+   or removing a key only ever moves the keys of one chunk around
+   no matter how long the sequence gets */
+#define FREE_INDEX_CHUNK 128
+
+typedef struct FreeChunk {
+  guint   len;
+  FreeKey keys[FREE_INDEX_CHUNK];
+} FreeChunk;
+
+typedef struct FreeIndex {
+  GPtrArray *chunks;  /* FreeChunk, none of them empty */
+} FreeIndex;
+
+/* a position in a FreeIndex; walking off either end leaves
+   chunk >= chunks->len (it wraps around going backwards) */
+typedef struct FreeCursor {
+  guint chunk;
+  guint off;
+} FreeCursor;
+
+#define FREE_INDEX_CHUNK_AT(index, i) \
+  ((FreeChunk *) g_ptr_array_index((index)->chunks, (i)))
+
+static inline gint
+free_key_cmp(const FreeKey *k,
+             guint          major,
+             guint          minor,
+             guint          pos)
+{
+  if (k->major != major)
+    return k->major < major ? -1 : 1;
+  else if (k->minor != minor)
+    return k->minor < minor ? -1 : 1;
+  else if (k->pos != pos)
+    return k->pos < pos ? -1 : 1;
+
+  return 0;
+}
+
+static void
+free_index_init(FreeIndex *index)
+{
+  index->chunks = g_ptr_array_new_with_free_func(g_free);
+}
+
+static void
+free_index_clear(FreeIndex *index)
+{
+  g_clear_pointer(&index->chunks, g_ptr_array_unref);
+}
+
+static inline gboolean
+free_cursor_valid(const FreeIndex  *index,
+                  const FreeCursor *c)
+{
+  return c->chunk < index->chunks->len;
+}
+
+static inline const FreeKey *
+free_cursor_get(const FreeIndex  *index,
+                const FreeCursor *c)
+{
+  return &FREE_INDEX_CHUNK_AT(index, c->chunk)->keys[c->off];
+}
+
+static inline void
+free_cursor_next(const FreeIndex *index,
+                 FreeCursor      *c)
+{
+  if (++c->off < FREE_INDEX_CHUNK_AT(index, c->chunk)->len)
+    return;
+
+  c->chunk++;
+  c->off = 0;
+}
+
+static inline void
+free_cursor_prev(const FreeIndex *index,
+                 FreeCursor      *c)
+{
+  if (c->off-- > 0)
+    return;
+
+  if (c->chunk-- > 0)
+    c->off = FREE_INDEX_CHUNK_AT(index, c->chunk)->len - 1;
+}
+
+static void
+free_index_last(const FreeIndex *index,
+                FreeCursor      *c)
+{
+  c->chunk = index->chunks->len - 1;
+  c->off = c->chunk < index->chunks->len ?
+    FREE_INDEX_CHUNK_AT(index, c->chunk)->len - 1 : 0;
+}
+
+/* place c on the first key that is not smaller than the given one */
+static void
+free_index_seek(const FreeIndex *index,
+                guint            major,
+                guint            minor,
+                guint            pos,
+                FreeCursor      *c)
+{
+  guint lo = 0;
+  guint hi = index->chunks->len;
+  FreeChunk *chunk;
+
+  /* the first chunk whose last key is not smaller */
+  while (lo < hi)
+    {
+      const guint mid = lo + (hi - lo) / 2;
+
+      chunk = FREE_INDEX_CHUNK_AT(index, mid);
+      if (free_key_cmp(&chunk->keys[chunk->len - 1], major, minor, pos) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  c->chunk = lo;
+  c->off = 0;
+
+  if (lo == index->chunks->len)
+    return;
+
+  chunk = FREE_INDEX_CHUNK_AT(index, lo);
+  hi = chunk->len - 1; /* that one is known to be not smaller */
+
+  while (c->off < hi)
+    {
+      const guint mid = c->off + (hi - c->off) / 2;
+
+      if (free_key_cmp(&chunk->keys[mid], major, minor, pos) < 0)
+        c->off = mid + 1;
+      else
+        hi = mid;
+    }
+}
+
+static void
+free_index_insert(FreeIndex *index,
+                  guint      major,
+                  guint      minor,
+                  guint      pos)
+{
+  FreeKey key = {major, minor, pos};
+  FreeChunk *chunk;
+  FreeCursor c;
+
+  free_index_seek(index, major, minor, pos, &c);
+
+  if (index->chunks->len == 0)
+    {
+      g_ptr_array_add(index->chunks, g_new(FreeChunk, 1));
+      FREE_INDEX_CHUNK_AT(index, 0)->len = 0;
+      c.chunk = c.off = 0;
+    }
+  else if (!free_cursor_valid(index, &c))
+    {
+      /* larger than everything, append to the last chunk */
+      c.chunk = index->chunks->len - 1;
+      c.off = FREE_INDEX_CHUNK_AT(index, c.chunk)->len;
+    }
+
+  chunk = FREE_INDEX_CHUNK_AT(index, c.chunk);
+
+  if (chunk->len == FREE_INDEX_CHUNK)
+    {
+      const guint half = FREE_INDEX_CHUNK / 2;
+      FreeChunk *upper = g_new(FreeChunk, 1);
+
+      upper->len = FREE_INDEX_CHUNK - half;
+      memcpy(upper->keys, chunk->keys + half, upper->len * sizeof(FreeKey));
+      chunk->len = half;
+
+      g_ptr_array_insert(index->chunks, c.chunk + 1, upper);
+
+      if (c.off > half)
+        {
+          chunk = upper;
+          c.off -= half;
+        }
+    }
+
+  memmove(chunk->keys + c.off + 1,
+          chunk->keys + c.off,
+          (chunk->len - c.off) * sizeof(FreeKey));
+
+  chunk->keys[c.off] = key;
+  chunk->len++;
+}
+
+static void
+free_index_remove(FreeIndex *index,
+                  guint      major,
+                  guint      minor,
+                  guint      pos)
+{
+  FreeChunk *chunk;
+  FreeCursor c;
+
+  free_index_seek(index, major, minor, pos, &c);
+
+  g_assert(free_cursor_valid(index, &c));
+  g_assert(free_key_cmp(free_cursor_get(index, &c), major, minor, pos) == 0);
+
+  chunk = FREE_INDEX_CHUNK_AT(index, c.chunk);
+  chunk->len--;
+
+  if (chunk->len == 0)
+    {
+      g_ptr_array_remove_index(index->chunks, c.chunk);
+      return;
+    }
+
+  memmove(chunk->keys + c.off,
+          chunk->keys + c.off + 1,
+          (chunk->len - c.off) * sizeof(FreeKey));
+}
+
+/* a free rect in its size heap, see gp_heap_meld() */
+typedef struct SizeNode {
+  guint child;
+  guint next;
+  guint prev;
+} SizeNode;
+
+struct _GGuillotinePacker {
+  GBinPacker parent;
+
+  GArray    *rects_free;
+
+  /* width and height of rects_free again, one array each, for
+     the scan kernels */
+  GArray    *free_w;
+  GArray    *free_h;
+
+  /* indices over rects_free, sorted by (width, height)
+     and (height, width) respectively */
+  FreeIndex  by_width;
+  FreeIndex  by_height;
+
+  /* top-left, top-right and bottom-left corner of each free
+     rect to its position in rects_free; free rects never overlap
+     so each corner is unique. Only maintained with merge_free */
+  PosMap     tl;
+  PosMap     tr;
+  PosMap     bl;
+
+  /* (width, height) to the root of a min-heap of the positions
+     of the free rects of that size, so the lowest is on top; the
+     heaps live in size_nodes, see gp_heap_meld() */
+  PosMap     sizes;
+  GArray    *size_nodes;
+
+  /* the free rect with the largest area, for the stats; only
+     looked for again once it is gone */
+  GRect      largest;
+  gboolean   largest_valid;
+
+  /* the parked free rects are the ones from n_active on, see
+     gp_parked(); park_below is min_free, or the narrowest bin
+     seen so far with G_GUILLOTINE_PACKER_MIN_FREE_AUTO */
+  guint      n_active;
+  guint      min_free;
+  guint      park_below;
+
+  GRectFit   fit_method;
+  GRectSplit split_method;
+  gboolean   merge_free;
+
+};
+
+enum {
+  PROP_GP_0,
+  PROP_GP_FREE_RECTS,
+  PROP_GP_MERGE_FREE,
+  PROP_GP_FIT_METHOD,
+  PROP_GP_SPLIT_METHOD,
+  PROP_GP_MIN_FREE_SIZE,
+  PROP_GP_LAST
+};
+static GParamSpec *gp_props[PROP_GP_LAST] = { NULL, };
+
+G_DEFINE_TYPE(GGuillotinePacker, g_guillotine_packer, G_TYPE_BIN_PACKER);
+
+/* the free list index: rects_free is unordered, by_width and
+   by_height hold (key, position) tuples sorted by the respective
+   side, so that all free rects that can hold a given bin are a
+   suffix of both and can be visited in order of increasing (or
+   decreasing) slack without looking at the rest */
+
+static void
+gp_index_insert(GGuillotinePacker *gp,
+                const GRect       *r,
+                guint              pos)
+{
+  free_index_insert(&gp->by_width,  r->width,  r->height, pos);
+  free_index_insert(&gp->by_height, r->height, r->width,  pos);
+}
+
+static void
+gp_index_remove(GGuillotinePacker *gp,
+                const GRect       *r,
+                guint              pos)
+{
+  free_index_remove(&gp->by_width,  r->width,  r->height, pos);
+  free_index_remove(&gp->by_height, r->height, r->width,  pos);
+}
+
+static void
+gp_index_move(GGuillotinePacker *gp,
+              const GRect       *r,
+              guint              from,
+              guint              to)
+{
+  gp_index_remove(gp, r, from);
+  gp_index_insert(gp, r, to);
+}
+
+static void
+gp_corners_insert(GGuillotinePacker *gp,
+                  const GRect       *r,
+                  guint              pos)
+{
+  if (!gp->merge_free)
+    return;
+
+  pos_map_insert(&gp->tl, POS_MAP_KEY(r->x, r->y), pos);
+  pos_map_insert(&gp->tr, POS_MAP_KEY(r->x + r->width, r->y), pos);
+  pos_map_insert(&gp->bl, POS_MAP_KEY(r->x, r->y + r->height), pos);
+}
+
+static void
+gp_corners_remove(GGuillotinePacker *gp,
+                  const GRect       *r)
+{
+  if (!gp->merge_free)
+    return;
+
+  pos_map_remove(&gp->tl, POS_MAP_KEY(r->x, r->y));
+  pos_map_remove(&gp->tr, POS_MAP_KEY(r->x + r->width, r->y));
+  pos_map_remove(&gp->bl, POS_MAP_KEY(r->x, r->y + r->height));
+}
+
+/* the size heaps are pairing heaps threaded through size_nodes,
+   which runs parallel to rects_free, so they need no memory of
+   their own. prev is the previous sibling, or the parent for the
+   first child; the key of a node is its position */
+#define GP_SIZE_NONE G_MAXUINT
+#define GP_SIZE_NODE(gp, pos) (&g_array_index((gp)->size_nodes, SizeNode, pos))
+
+/* a and b are roots, the larger one becomes the first child of
+   the other, which is returned */
+static guint
+gp_heap_meld(GGuillotinePacker *gp,
+             guint              a,
+             guint              b)
+{
+  SizeNode *p, *c;
+
+  if (b < a)
+    {
+      const guint t = a;
+
+      a = b;
+      b = t;
+    }
+
+  p = GP_SIZE_NODE(gp, a);
+  c = GP_SIZE_NODE(gp, b);
+
+  c->next = p->child;
+  c->prev = a;
+
+  if (p->child != GP_SIZE_NONE)
+    GP_SIZE_NODE(gp, p->child)->prev = b;
+
+  p->child = b;
+
+  return a;
+}
+
+/* the siblings from first on as one heap: melded in pairs from
+   left to right, then the pairs from right to left */
+static guint
+gp_heap_merge_pairs(GGuillotinePacker *gp,
+                    guint              first)
+{
+  guint pairs = GP_SIZE_NONE;
+  guint a, root;
+
+  for (a = first; a != GP_SIZE_NONE; )
+    {
+      SizeNode *n = GP_SIZE_NODE(gp, a);
+      guint b = n->next, rest = GP_SIZE_NONE;
+
+      n->next = GP_SIZE_NONE;
+
+      if (b != GP_SIZE_NONE)
+        {
+          rest = GP_SIZE_NODE(gp, b)->next;
+          GP_SIZE_NODE(gp, b)->next = GP_SIZE_NONE;
+          a = gp_heap_meld(gp, a, b);
+        }
+
+      /* the pairs are linked through next, last one first */
+      GP_SIZE_NODE(gp, a)->next = pairs;
+      pairs = a;
+      a = rest;
+    }
+
+  if (pairs == GP_SIZE_NONE)
+    return GP_SIZE_NONE;
+
+  root = pairs;
+  pairs = GP_SIZE_NODE(gp, root)->next;
+  GP_SIZE_NODE(gp, root)->next = GP_SIZE_NONE;
+
+  while (pairs != GP_SIZE_NONE)
+    {
+      const guint n = GP_SIZE_NODE(gp, pairs)->next;
+
+      GP_SIZE_NODE(gp, pairs)->next = GP_SIZE_NONE;
+      root = gp_heap_meld(gp, root, pairs);
+      pairs = n;
+    }
+
+  GP_SIZE_NODE(gp, root)->prev = GP_SIZE_NONE;
+
+  return root;
+}
+
+/* take the subtree at pos, which is not a root, out of its heap */
+static void
+gp_heap_cut(GGuillotinePacker *gp,
+            guint              pos)
+{
+  SizeNode *n = GP_SIZE_NODE(gp, pos);
+  SizeNode *p = GP_SIZE_NODE(gp, n->prev);
+
+  if (p->child == pos)
+    p->child = n->next;
+  else
+    p->next = n->next;
+
+  if (n->next != GP_SIZE_NONE)
+    GP_SIZE_NODE(gp, n->next)->prev = n->prev;
+
+  n->next = n->prev = GP_SIZE_NONE;
+}
+
+static void
+gp_sizes_insert(GGuillotinePacker *gp,
+                const GRect       *r,
+                guint              pos)
+{
+  const guint64 key = POS_MAP_KEY(r->width, r->height);
+  SizeNode *n = GP_SIZE_NODE(gp, pos);
+  guint root;
+
+  n->child = n->next = n->prev = GP_SIZE_NONE;
+
+  if (pos_map_lookup(&gp->sizes, key, &root))
+    {
+      if (gp_heap_meld(gp, root, pos) == root)
+        return;
+    }
+
+  pos_map_insert(&gp->sizes, key, pos);
+}
+
+static void
+gp_sizes_remove(GGuillotinePacker *gp,
+                const GRect       *r,
+                guint              pos)
+{
+  const guint64 key = POS_MAP_KEY(r->width, r->height);
+  const SizeNode *n = GP_SIZE_NODE(gp, pos);
+  guint root = pos, sub;
+
+  if (n->prev == GP_SIZE_NONE)
+    {
+      root = gp_heap_merge_pairs(gp, n->child);
+
+      if (root == GP_SIZE_NONE)
+        pos_map_remove(&gp->sizes, key);
+      else
+        pos_map_insert(&gp->sizes, key, root);
+
+      return;
+    }
+
+  gp_heap_cut(gp, pos);
+  sub = gp_heap_merge_pairs(gp, n->child);
+
+  if (sub == GP_SIZE_NONE)
+    return;
+
+  pos_map_lookup(&gp->sizes, key, &root);
+
+  if (gp_heap_meld(gp, root, sub) != root)
+    pos_map_insert(&gp->sizes, key, sub);
+}
+
+/* the free rect r at from is about to be moved to to, which is
+   lower, so that its key goes down */
+static void
+gp_sizes_move(GGuillotinePacker *gp,
+              const GRect       *r,
+              guint              from,
+              guint              to)
+{
+  const guint64 key = POS_MAP_KEY(r->width, r->height);
+  SizeNode *n = GP_SIZE_NODE(gp, to);
+  guint root = 0;
+
+  *n = *GP_SIZE_NODE(gp, from);
+
+  if (n->child != GP_SIZE_NONE)
+    GP_SIZE_NODE(gp, n->child)->prev = to;
+
+  if (n->prev == GP_SIZE_NONE)
+    {
+      pos_map_insert(&gp->sizes, key, to);
+      return;
+    }
+
+  /* point the parent or sibling at the new place first */
+  if (GP_SIZE_NODE(gp, n->prev)->child == from)
+    GP_SIZE_NODE(gp, n->prev)->child = to;
+  else
+    GP_SIZE_NODE(gp, n->prev)->next = to;
+
+  if (n->next != GP_SIZE_NONE)
+    GP_SIZE_NODE(gp, n->next)->prev = to;
+
+  gp_heap_cut(gp, to);
+  pos_map_lookup(&gp->sizes, key, &root);
+
+  if (gp_heap_meld(gp, root, to) != root)
+    pos_map_insert(&gp->sizes, key, to);
+}
+
+/* lowest position of a free rect of exactly w x h, G_MAXUINT if
+   there is none; n counts the lookups that found one */
+static guint
+gp_sizes_first(GGuillotinePacker *gp,
+               guint              w,
+               guint              h,
+               guint             *n)
+{
+  guint root;
+
+  if (!pos_map_lookup(&gp->sizes, POS_MAP_KEY(w, h), &root))
+    return G_MAXUINT;
+
+  (*n)++;
+  return root;
+}
+
+/* free rects narrower or shorter than park_below are parked
+   behind the others in rects_free, from n_active on: they are
+   still in the corner maps and can merge back into something
+   useful, but neither in the indices nor the size map, and the
+   scan stops at n_active */
+static inline gboolean
+gp_parked(GGuillotinePacker *gp,
+          const GRect       *r)
+{
+  return r->width < gp->park_below || r->height < gp->park_below;
+}
+
+static void
+gp_free_resize(GGuillotinePacker *gp,
+               guint              len)
+{
+  g_array_set_size(gp->rects_free, len);
+  g_array_set_size(gp->free_w, len);
+  g_array_set_size(gp->free_h, len);
+  g_array_set_size(gp->size_nodes, len);
+}
+
+/* move the free rect at from into the hole at to, on the same
+   side of n_active */
+static void
+gp_free_move(GGuillotinePacker *gp,
+             guint              from,
+             guint              to)
+{
+  GRect *r = &g_array_index(gp->rects_free, GRect, from);
+
+  if (from < gp->n_active)
+    {
+      gp_index_move(gp, r, from, to);
+      gp_sizes_move(gp, r, from, to);
+    }
+
+  gp_corners_insert(gp, r, to);
+
+  g_array_index(gp->rects_free, GRect, to) = *r;
+  g_array_index(gp->free_w, guint, to) = g_array_index(gp->free_w, guint, from);
+  g_array_index(gp->free_h, guint, to) = g_array_index(gp->free_h, guint, from);
+}
+
+/* all modifications of rects_free must go through these
+   so that the indices stay in sync */
+static guint
+gp_free_add(GGuillotinePacker *gp,
+            const GRect       *r)
+{
+  guint pos = gp->rects_free->len;
+
+  gp_free_resize(gp, pos + 1);
+
+  if (!gp_parked(gp, r))
+    {
+      /* make room in front of the parked ones */
+      if (gp->n_active < pos)
+        {
+          gp_free_move(gp, gp->n_active, pos);
+          pos = gp->n_active;
+        }
+
+      gp->n_active++;
+    }
+
+  g_array_index(gp->rects_free, GRect, pos) = *r;
+  g_array_index(gp->free_w, guint, pos) = r->width;
+  g_array_index(gp->free_h, guint, pos) = r->height;
+
+  if (pos < gp->n_active)
+    {
+      gp_index_insert(gp, r, pos);
+      gp_sizes_insert(gp, r, pos);
+    }
+
+  gp_corners_insert(gp, r, pos);
+
+  if (gp->largest_valid && bp_rect_larger(r, &gp->largest))
+    gp->largest = *r;
+
+  return pos;
+}
+
+static void
+gp_free_remove(GGuillotinePacker *gp,
+               guint              pos)
+{
+  GRect *r = &g_array_index(gp->rects_free, GRect, pos);
+  guint last;
+
+  if (bp_rect_same(r, &gp->largest))
+    gp->largest_valid = FALSE;
+
+  if (pos < gp->n_active)
+    {
+      gp_index_remove(gp, r, pos);
+      gp_sizes_remove(gp, r, pos);
+    }
+
+  gp_corners_remove(gp, r);
+
+  /* fill the hole from the end of its own part; for an active
+     rect that leaves one at the start of the parked part, which
+     is filled from the very end */
+  if (pos < gp->n_active)
+    {
+      if (pos != gp->n_active - 1)
+        gp_free_move(gp, gp->n_active - 1, pos);
+
+      pos = --gp->n_active;
+    }
+
+  last = gp->rects_free->len - 1;
+  if (pos != last)
+    gp_free_move(gp, last, pos);
+
+  gp_free_resize(gp, last);
+}
+
+/* returns where r ended up, which is only somewhere else if it
+   has to be parked or unparked */
+static guint
+gp_free_replace(GGuillotinePacker *gp,
+                guint              pos,
+                const GRect       *r)
+{
+  GRect *f = &g_array_index(gp->rects_free, GRect, pos);
+  const gboolean active = pos < gp->n_active;
+
+  if (active == gp_parked(gp, r))
+    {
+      gp_free_remove(gp, pos);
+      return gp_free_add(gp, r);
+    }
+
+  if (bp_rect_same(f, &gp->largest))
+    gp->largest_valid = FALSE;
+  else if (gp->largest_valid && bp_rect_larger(r, &gp->largest))
+    gp->largest = *r;
+
+  if (active)
+    {
+      gp_index_remove(gp, f, pos);
+      gp_sizes_remove(gp, f, pos);
+    }
+
+  gp_corners_remove(gp, f);
+  *f = *r;
+  g_array_index(gp->free_w, guint, pos) = r->width;
+  g_array_index(gp->free_h, guint, pos) = r->height;
+
+  if (active)
+    {
+      gp_index_insert(gp, f, pos);
+      gp_sizes_insert(gp, f, pos);
+    }
+
+  gp_corners_insert(gp, f, pos);
+
+  return pos;
+}
+
+/* start over with the free rects in rf, parking them anew */
+static void
+gp_free_reset(GGuillotinePacker *gp,
+              const GArray      *rf)
+{
+  guint i;
+
+  while (gp->rects_free->len > 0)
+    gp_free_remove(gp, gp->rects_free->len - 1);
+
+  for (i = 0; i < rf->len; i++)
+    gp_free_add(gp, &g_array_index(rf, GRect, i));
+}
+
+/* with G_GUILLOTINE_PACKER_MIN_FREE_AUTO nothing narrower than the
+   narrowest side of any bin seen so far is of any use; nothing is
+   parked before the first one */
+static void
+gp_free_seen(GGuillotinePacker *gp,
+             const GRect       *bins,
+             guint              n_bins)
+{
+  guint side = gp->park_below;
+  gboolean first;
+  guint k;
+
+  if (gp->min_free != G_GUILLOTINE_PACKER_MIN_FREE_AUTO)
+    return;
+
+  for (k = 0; k < n_bins; k++)
+    if (bins[k].x == G_RECT_UNPLACED &&
+        (side == 0 || MIN(bins[k].width, bins[k].height) < side))
+      side = MIN(bins[k].width, bins[k].height);
+
+  if (side == gp->park_below)
+    return;
+
+  first = gp->park_below == 0;
+  gp->park_below = side;
+
+  /* the first bins park whatever is too small for them, later
+     ones can only unpark; either way only the rects that change
+     sides move, the ones they pass have been looked at already */
+  if (first)
+    {
+      for (k = gp->n_active; k-- > 0; )
+        {
+          const GRect r = g_array_index(gp->rects_free, GRect, k);
+
+          if (gp_parked(gp, &r))
+            gp_free_replace(gp, k, &r);
+        }
+    }
+  else
+    {
+      k = gp->n_active;
+
+      while (k < gp->rects_free->len)
+        {
+          const GRect r = g_array_index(gp->rects_free, GRect, k);
+
+          if (gp_parked(gp, &r))
+            {
+              k++;
+              continue;
+            }
+
+          /* the last rect fills the hole at k unless r went
+             right back there, in front of the parked ones */
+          gp_free_replace(gp, k, &r);
+          k = MAX(k, gp->n_active);
+        }
+    }
+}
+
+static void
+g_guillotine_packer_finalize(GObject *obj)
+{
+  GGuillotinePacker *gp = G_GUILLOTINE_PACKER(obj);
+
+  g_array_free(gp->rects_free, TRUE);
+  g_array_free(gp->free_w, TRUE);
+  g_array_free(gp->free_h, TRUE);
+  g_array_free(gp->size_nodes, TRUE);
+  free_index_clear(&gp->by_width);
+  free_index_clear(&gp->by_height);
+  pos_map_clear(&gp->sizes);
+
+  pos_map_clear(&gp->tl);
+  pos_map_clear(&gp->tr);
+  pos_map_clear(&gp->bl);
+
+  G_OBJECT_CLASS(g_guillotine_packer_parent_class)->finalize(obj);
+}
+
+static void
+g_guillotine_packer_get_property(GObject    *object,
+                                 guint       prop_id,
+                                 GValue     *value,
+                                 GParamSpec *pspec)
+{
+  GGuillotinePacker *gp = G_GUILLOTINE_PACKER(object);
+
+  switch (prop_id) {
+  case PROP_GP_FREE_RECTS:
+    g_value_set_boxed(value, gp->rects_free);
+    break;
+
+  case PROP_GP_MERGE_FREE:
+    g_value_set_boolean(value, gp->merge_free);
+    break;
+
+  case PROP_GP_FIT_METHOD:
+    g_value_set_uint(value, gp->fit_method);
+    break;
+
+  case PROP_GP_SPLIT_METHOD:
+    g_value_set_uint(value, gp->split_method);
+    break;
+
+  case PROP_GP_MIN_FREE_SIZE:
+    g_value_set_uint(value, gp->min_free);
+    break;
+  }
+}
+
+
+static void
+g_guillotine_packer_set_property(GObject      *object,
+                                 guint         prop_id,
+                                 const GValue *value,
+                                 GParamSpec   *pspec)
+{
+  GGuillotinePacker *gp = G_GUILLOTINE_PACKER(object);
+
+  switch (prop_id) {
+  case PROP_GP_MERGE_FREE:
+     gp->merge_free = g_value_get_boolean(value);
+    break;
+
+  case PROP_GP_FIT_METHOD:
+    gp->fit_method = g_value_get_uint(value);
+    break;
+
+  case PROP_GP_SPLIT_METHOD:
+    gp->split_method = g_value_get_uint(value);
+    break;
+
+  case PROP_GP_MIN_FREE_SIZE:
+    gp->min_free = g_value_get_uint(value);
+    if (gp->min_free != G_GUILLOTINE_PACKER_MIN_FREE_AUTO)
+      gp->park_below = gp->min_free;
+    break;
+  }
+}
+
+
+static void
+g_guillotine_packer_constructed(GObject *obj)
+{
+  GGuillotinePacker *gp = G_GUILLOTINE_PACKER(obj);
+  GBinPackerPrivate *priv = BP_GET_PRIV(gp);
+  GRect r = {0, };
+
+  G_OBJECT_CLASS(g_guillotine_packer_parent_class)->constructed(obj);
+
+  r.width  = priv->width;
+  r.height = priv->height;
+
+  if (gp->merge_free)
+    {
+      pos_map_init(&gp->tl, 64);
+      pos_map_init(&gp->tr, 64);
+      pos_map_init(&gp->bl, 64);
+    }
+
+  gp_free_add(gp, &r);
+}
+
+static void
+g_guillotine_packer_init(GGuillotinePacker *gp)
+{
+  gp->rects_free = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+  gp->free_w = g_array_sized_new(FALSE, FALSE, sizeof(guint), 1);
+  gp->free_h = g_array_sized_new(FALSE, FALSE, sizeof(guint), 1);
+  gp->size_nodes = g_array_sized_new(FALSE, FALSE, sizeof(SizeNode), 1);
+  free_index_init(&gp->by_width);
+  free_index_init(&gp->by_height);
+  pos_map_init(&gp->sizes, 64);
+  gp->largest_valid = TRUE;
+}
+
+static GArray *
+g_guillotine_packer_insert_bins(GBinPacker *packer,
+                                GArray     *bins)
+{
+  return g_guillotine_packer_insert(G_GUILLOTINE_PACKER(packer), bins);
+}
+
+static gboolean gp_pack(GGuillotinePacker *gp,
+                        GRect             *r);
+
+static gboolean
+g_guillotine_packer_pack_rect(GBinPacker *packer,
+                              GRect      *r)
+{
+  return gp_pack(G_GUILLOTINE_PACKER(packer), r);
+}
+
+static guint gp_place_pending(GGuillotinePacker *gp,
+                              GRect             *rects,
+                              guint              n_rects,
+                              guint             *order);
+
+static guint
+g_guillotine_packer_place_rects(GBinPacker *packer,
+                                GRect      *rects,
+                                guint       n_rects,
+                                guint      *order)
+{
+  return gp_place_pending(G_GUILLOTINE_PACKER(packer), rects, n_rects, order);
+}
+
+static void g_guillotine_packer_release(GBinPacker  *packer,
+                                        const GRect *rect);
+static void g_guillotine_packer_grow(GBinPacker *packer,
+                                     guint       old_width,
+                                     guint       old_height);
+static void g_guillotine_packer_save(GBinPacker *packer,
+                                     GByteArray *out);
+static gboolean g_guillotine_packer_load(GBinPacker    *packer,
+                                         const guint8 **data,
+                                         gsize         *size);
+static gboolean g_guillotine_packer_free_space(GBinPacker *packer,
+                                               GArray     *rects);
+static void g_guillotine_packer_stats(GBinPacker      *packer,
+                                      GBinPackerStats *stats);
+
+static void
+g_guillotine_packer_class_init(GGuillotinePackerClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+  gobject_class->finalize     = g_guillotine_packer_finalize;
+  gobject_class->get_property = g_guillotine_packer_get_property;
+  gobject_class->set_property = g_guillotine_packer_set_property;
+  gobject_class->constructed  = g_guillotine_packer_constructed;
+
+  G_BIN_PACKER_CLASS(klass)->release = g_guillotine_packer_release;
+  G_BIN_PACKER_CLASS(klass)->grow    = g_guillotine_packer_grow;
+  G_BIN_PACKER_CLASS(klass)->insert  = g_guillotine_packer_insert_bins;
+  G_BIN_PACKER_CLASS(klass)->pack    = g_guillotine_packer_pack_rect;
+  G_BIN_PACKER_CLASS(klass)->place   = g_guillotine_packer_place_rects;
+  G_BIN_PACKER_CLASS(klass)->save    = g_guillotine_packer_save;
+  G_BIN_PACKER_CLASS(klass)->load    = g_guillotine_packer_load;
+  G_BIN_PACKER_CLASS(klass)->free_space = g_guillotine_packer_free_space;
+  G_BIN_PACKER_CLASS(klass)->stats   = g_guillotine_packer_stats;
+
+  rect_scan_resolve();
+
+  gp_props[PROP_GP_FREE_RECTS] =
+    g_param_spec_boxed("free-rects",
+                       NULL, NULL,
+                       G_TYPE_ARRAY,
+                       G_PARAM_READABLE |
+                       G_PARAM_STATIC_NICK);
+
+  gp_props[PROP_GP_MERGE_FREE] =
+    g_param_spec_boolean("merge-free", NULL, NULL, TRUE,
+                         G_PARAM_READWRITE |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_NICK);
+
+  gp_props[PROP_GP_FIT_METHOD] =
+    g_param_spec_uint("fit-method",
+                      NULL, NULL,
+                      G_RECT_FIT_AREA_BEST,
+                      G_RECT_FIT_LONG_SIDE_WORST,
+                      G_RECT_FIT_SHORT_SIDE_BEST,
+                      G_PARAM_READWRITE |
+                      G_PARAM_CONSTRUCT_ONLY |
+                      G_PARAM_STATIC_NICK);
+
+    gp_props[PROP_GP_SPLIT_METHOD] =
+    g_param_spec_uint("split-method",
+                      NULL, NULL,
+                      G_RECT_SPLIT_AREA_MAX,
+                      G_RECT_SPLIT_AREA_MIN,
+                      G_RECT_SPLIT_AREA_MAX,
+                      G_PARAM_READWRITE |
+                      G_PARAM_CONSTRUCT_ONLY |
+                      G_PARAM_STATIC_NICK);
+
+  gp_props[PROP_GP_MIN_FREE_SIZE] =
+    g_param_spec_uint("min-free-size",
+                      NULL, NULL,
+                      0,
+                      G_GUILLOTINE_PACKER_MIN_FREE_AUTO,
+                      0,
+                      G_PARAM_READWRITE |
+                      G_PARAM_CONSTRUCT_ONLY |
+                      G_PARAM_STATIC_NICK);
+
+  g_object_class_install_properties(gobject_class,
+                                    PROP_GP_LAST,
+                                    gp_props);
+}
+
+/* find a free rect that shares a full edge with the one at pos */
+static gboolean
+gp_find_merge_partner(GGuillotinePacker *gp,
+                      guint              pos,
+                      guint             *partner)
+{
+  const GRect *r = &g_array_index(gp->rects_free, GRect, pos);
+  const GRect *n;
+  guint i;
+
+  /* right of r: its top-left corner is our top-right */
+  if (pos_map_lookup(&gp->tl, POS_MAP_KEY(r->x + r->width, r->y), &i))
+    {
+      n = &g_array_index(gp->rects_free, GRect, i);
+      if (n->height == r->height)
+        goto found;
+    }
+
+  /* left of r: its top-right corner is our top-left */
+  if (pos_map_lookup(&gp->tr, POS_MAP_KEY(r->x, r->y), &i))
+    {
+      n = &g_array_index(gp->rects_free, GRect, i);
+      if (n->height == r->height)
+        goto found;
+    }
+
+  /* below r: its top-left corner is our bottom-left */
+  if (pos_map_lookup(&gp->tl, POS_MAP_KEY(r->x, r->y + r->height), &i))
+    {
+      n = &g_array_index(gp->rects_free, GRect, i);
+      if (n->width == r->width)
+        goto found;
+    }
+
+  /* above r: its bottom-left corner is our top-left */
+  if (pos_map_lookup(&gp->bl, POS_MAP_KEY(r->x, r->y), &i))
+    {
+      n = &g_array_index(gp->rects_free, GRect, i);
+      if (n->width == r->width)
+        goto found;
+    }
+
+  return FALSE;
+
+ found:
+  *partner = i;
+  return TRUE;
+}
+
+/* merge the free rect at pos with its neighbours for as long as
+   that is possible. If the free list had no mergeable pair before
+   the rect at pos was added, it has none afterwards either, so
+   merging the rects produced by a split is all that is needed */
+static guint
+gp_merge_free_rect(GGuillotinePacker *gp,
+                   guint              pos)
+{
+  guint merged = 0;
+  guint partner;
+
+  while (gp_find_merge_partner(gp, pos, &partner))
+    {
+      const GRect *f = &g_array_index(gp->rects_free, GRect, pos);
+      const guint64 key = POS_MAP_KEY(f->x, f->y);
+      GRect u;
+
+      g_rect_merge(f, &g_array_index(gp->rects_free, GRect, partner), &u);
+
+      gp_free_remove(gp, partner);
+
+      /* that may have moved us into the hole */
+      pos_map_lookup(&gp->tl, key, &pos);
+
+      pos = gp_free_replace(gp, pos, &u);
+      merged += 1;
+    }
+
+  BP_COUNT(BP_GET_PRIV(gp), merges, merged);
+
+  return merged;
+}
+
+/* give r back to the free list, merged with its neighbours */
+static void
+gp_free_release(GGuillotinePacker *gp,
+                const GRect       *r)
+{
+  const guint pos = gp_free_add(gp, r);
+
+  if (gp->merge_free)
+    gp_merge_free_rect(gp, pos);
+}
+
+/* pairwise merging cannot always undo the splits, so once the
+   last rect is gone the free list starts over as the whole atlas */
+static void
+g_guillotine_packer_release(GBinPacker  *packer,
+                            const GRect *rect)
+{
+  GGuillotinePacker *gp = G_GUILLOTINE_PACKER(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(gp);
+  GRect r = {0, };
+
+  if (bp_rects_len(priv) > 0)
+    {
+      gp_free_release(gp, rect);
+      return;
+    }
+
+  while (gp->rects_free->len > 0)
+    gp_free_remove(gp, gp->rects_free->len - 1);
+
+  r.width = priv->width;
+  r.height = priv->height;
+  gp_free_add(gp, &r);
+}
+
+/* the new space is a strip to the right, spanning the full new
+   height, and one below the old area */
+static void
+g_guillotine_packer_grow(GBinPacker *packer,
+                         guint       old_width,
+                         guint       old_height)
+{
+  GGuillotinePacker *gp = G_GUILLOTINE_PACKER(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(gp);
+  GRect r = {0, };
+
+  r.x = old_width;
+  r.width = priv->width - old_width;
+  r.height = priv->height;
+
+  if (g_rect_area_nonzero(&r))
+    gp_free_release(gp, &r);
+
+  r.x = 0;
+  r.y = old_height;
+  r.width = old_width;
+  r.height = priv->height - old_height;
+
+  if (g_rect_area_nonzero(&r))
+    gp_free_release(gp, &r);
+}
+
+/* park_below first, it depends on the bins seen so far with
+   G_GUILLOTINE_PACKER_MIN_FREE_AUTO */
+static void
+g_guillotine_packer_save(GBinPacker *packer,
+                         GByteArray *out)
+{
+  GGuillotinePacker *gp = G_GUILLOTINE_PACKER(packer);
+
+  bp_write_u32(out, gp->park_below);
+  bp_write_rects(out, gp->rects_free);
+}
+
+/* the free rects go in one by one, which builds the indices and
+   parks them as before */
+static gboolean
+g_guillotine_packer_load(GBinPacker    *packer,
+                         const guint8 **data,
+                         gsize         *size)
+{
+  GGuillotinePacker *gp = G_GUILLOTINE_PACKER(packer);
+  GArray *rf = g_array_new(FALSE, FALSE, sizeof(GRect));
+  guint32 park_below = 0;
+  gboolean ok;
+
+  ok = bp_read_u32(data, size, &park_below) &&
+       (gp->min_free == G_GUILLOTINE_PACKER_MIN_FREE_AUTO ||
+        park_below == gp->min_free) &&
+       bp_read_rects(data, size, rf) &&
+       bp_rects_inside(BP_GET_PRIV(gp), rf);
+
+  if (ok)
+    gp->park_below = park_below;
+
+  if (!ok)
+    g_array_set_size(rf, 0);
+
+  gp_free_reset(gp, rf);
+  g_array_free(rf, TRUE);
+
+  return ok;
+}
+
+static gboolean
+g_guillotine_packer_free_space(GBinPacker *packer,
+                               GArray     *rects)
+{
+  GArray *rf = G_GUILLOTINE_PACKER(packer)->rects_free;
+
+  g_array_append_vals(rects, rf->data, rf->len);
+  return TRUE;
+}
+
+static const GRect *
+gp_largest(GGuillotinePacker *gp)
+{
+  guint i;
+
+  if (gp->largest_valid)
+    return &gp->largest;
+
+  memset(&gp->largest, 0, sizeof(GRect));
+
+  for (i = 0; i < gp->rects_free->len; i++)
+    {
+      const GRect *r = &g_array_index(gp->rects_free, GRect, i);
+
+      if (bp_rect_larger(r, &gp->largest))
+        gp->largest = *r;
+    }
+
+  gp->largest_valid = TRUE;
+  return &gp->largest;
+}
+
+static void
+g_guillotine_packer_stats(GBinPacker      *packer,
+                          GBinPackerStats *stats)
+{
+  GGuillotinePacker *gp = G_GUILLOTINE_PACKER(packer);
+
+  stats->n_free_rects = gp->rects_free->len;
+  stats->largest_free = *gp_largest(gp);
+}
+
+/* the best placement found so far; ties are broken by the
+   position in the free list and then by the bin index, which
+   is the order a plain nested scan would have found them in,
+   the upright bin wins over the turned one */
+typedef struct GPFit {
+  gint64   score;
+  guint    pos;
+  guint    idx;
+  gboolean rotated;
+} GPFit;
+
+static inline gboolean
+gp_fit_update(GPFit    *best,
+              gint64    score,
+              guint     pos,
+              guint     idx,
+              gboolean  rotated)
+{
+  if (score > best->score)
+    return FALSE;
+
+  if (score == best->score &&
+      (pos > best->pos ||
+       (pos == best->pos &&
+        (idx > best->idx || (idx == best->idx && rotated >= best->rotated)))))
+    return FALSE;
+
+  best->score = score;
+  best->pos = pos;
+  best->idx = idx;
+  best->rotated = rotated;
+
+  return TRUE;
+}
+
+/* lower bound for the score of any free rect that leaves at
+   least dw horizontal and dh vertical slack around b (or at most
+   that much, for the "worst" heuristics) */
+static gint64
+gp_fit_bound(const GRect *b,
+             gint64       dw,
+             gint64       dh,
+             GRectFit     method)
+{
+  gint64 bound;
+
+  switch (method)
+    {
+    case G_RECT_FIT_AREA_BEST:
+    case G_RECT_FIT_AREA_WORST:
+      bound = (b->width + dw) * (b->height + dh) -
+              (gint64) b->width * b->height;
+      break;
+
+    case G_RECT_FIT_SHORT_SIDE_BEST:
+    case G_RECT_FIT_SHORT_SIDE_WORST:
+      bound = MIN(dw, dh);
+      break;
+
+    case G_RECT_FIT_LONG_SIDE_BEST:
+    case G_RECT_FIT_LONG_SIDE_WORST:
+    default:
+      bound = MAX(dw, dh);
+      break;
+    }
+
+  if (!G_RECT_FIT_IS_BEST(method))
+    bound *= -1;
+
+  return bound;
+}
+
+/* plain scan over all pairs of free rects and bins, one bin at a
+   time over the whole free list; cheaper than the index lookups
+   as long as the free list is short */
+static void
+gp_scan(GGuillotinePacker *gp,
+        const GRect       *bins,
+        guint              n_bins,
+        GPFit             *best)
+{
+  GBinPackerPrivate *base = BP_GET_PRIV(gp);
+  const gboolean turn = base->allow_rotation;
+  const guint *fw = (const guint *) gp->free_w->data;
+  const guint *fh = (const guint *) gp->free_h->data;
+  guint k;
+
+  for (k = 0; k < n_bins; k++)
+    {
+      const GRect *b = &bins[k];
+      const guint n = gp->n_active;
+      guint pos;
+      gint score;
+
+      if (b->x != G_RECT_UNPLACED)
+        continue;
+
+      rect_scan(fw, fh, n, b->width, b->height, gp->fit_method,
+                  &score, &pos);
+      BP_COUNT(base, scored, n);
+
+      if (pos != G_MAXUINT)
+        gp_fit_update(best, score, pos, k, FALSE);
+
+      if (!turn || b->width == b->height)
+        continue;
+
+      rect_scan(fw, fh, n, b->height, b->width, gp->fit_method,
+                &score, &pos);
+      BP_COUNT(base, scored, n);
+
+      if (pos != G_MAXUINT)
+        gp_fit_update(best, score, pos, k, TRUE);
+    }
+}
+
+/* find the best free rect for the bin b (at index idx of the
+   pending bins) and record it in best if it beats the current
+   one. Exact matches are left to gp_exact(); everything else is
+   visited by walking both indices in order of increasing slack
+   (decreasing for the "worst" heuristics), always advancing the
+   one that is behind. Any free rect not yet seen by either walk
+   has at least the slack of both fronts, so once the bound for
+   the fronts is worse than the best score we can stop */
+static void
+gp_index_query(GGuillotinePacker *gp,
+               const GRect       *b,
+               guint              idx,
+               gboolean           rotated,
+               GPFit             *best)
+{
+  const gboolean ascending = G_RECT_FIT_IS_BEST(gp->fit_method);
+  const FreeIndex *bw = &gp->by_width;
+  const FreeIndex *bh = &gp->by_height;
+  const FreeIndex *index;
+  FreeCursor cw, ch;
+  FreeCursor *cursor;
+  FreeCursor next;
+  guint n_scored = 0;
+  guint need;
+
+  if (ascending)
+    {
+      free_index_seek(bw, b->width, 0, 0, &cw);
+      free_index_seek(bh, b->height, 0, 0, &ch);
+    }
+  else
+    {
+      free_index_last(bw, &cw);
+      free_index_last(bh, &ch);
+    }
+
+  while (free_cursor_valid(bw, &cw) && free_cursor_valid(bh, &ch))
+    {
+      const FreeKey *kw = free_cursor_get(bw, &cw);
+      const FreeKey *kh = free_cursor_get(bh, &ch);
+      const FreeKey *k;
+      gint64 dw, dh;
+      const GRect *f;
+
+      if (kw->major < b->width || kh->major < b->height)
+        break;
+
+      dw = kw->major - b->width;
+      dh = kh->major - b->height;
+
+      if (gp_fit_bound(b, dw, dh, gp->fit_method) > best->score)
+        break;
+
+      if ((dw <= dh) == ascending)
+        {
+          k = kw;
+          index = bw;
+          cursor = &cw;
+          need = b->height;
+        }
+      else
+        {
+          k = kh;
+          index = bh;
+          cursor = &ch;
+          need = b->width;
+        }
+
+      next = *cursor;
+      if (ascending)
+        free_cursor_next(index, &next);
+      else
+        free_cursor_prev(index, &next);
+
+      if (k->minor < need)
+        {
+          /* too small on the other side, and so is the rest of the
+             run with the same major key after it, skip all of it */
+          if (free_cursor_valid(index, &next) &&
+              free_cursor_get(index, &next)->major == k->major)
+            {
+              if (ascending)
+                free_index_seek(index, k->major, need, 0, &next);
+              else
+                {
+                  free_index_seek(index, k->major, 0, 0, &next);
+                  free_cursor_prev(index, &next);
+                }
+            }
+
+          *cursor = next;
+          continue;
+        }
+
+      *cursor = next;
+
+      f = &g_array_index(gp->rects_free, GRect, k->pos);
+      gp_fit_update(best, g_rect_fit(f, b, gp->fit_method),
+                    k->pos, idx, rotated);
+      n_scored++;
+    }
+
+  BP_COUNT(BP_GET_PRIV(gp), scored, n_scored);
+}
+
+/* exact matches of any of the pending bins, straight from the
+   size map; nothing can beat them so the scoring is skipped
+   entirely when there is one */
+static gboolean
+gp_exact(GGuillotinePacker *gp,
+         const GRect       *bins,
+         guint              n_bins,
+         GPFit             *best)
+{
+  GBinPackerPrivate *base = BP_GET_PRIV(gp);
+  const gboolean turn = base->allow_rotation;
+  guint n_scored = 0;
+  guint k;
+
+  for (k = 0; k < n_bins; k++)
+    {
+      const GRect *b = &bins[k];
+      guint pos;
+
+      if (b->x != G_RECT_UNPLACED)
+        continue;
+
+      pos = gp_sizes_first(gp, b->width, b->height, &n_scored);
+      if (pos != G_MAXUINT)
+        gp_fit_update(best, G_MININT, pos, k, FALSE);
+
+      if (!turn || b->width == b->height)
+        continue;
+
+      pos = gp_sizes_first(gp, b->height, b->width, &n_scored);
+      if (pos != G_MAXUINT)
+        gp_fit_update(best, G_MININT, pos, k, TRUE);
+    }
+
+  BP_COUNT(base, scored, n_scored);
+
+  return best->score == G_MININT;
+}
+
+/* find the best free rect for any of the bins still at
+   G_RECT_UNPLACED, in either orientation if rotation is allowed */
+static gboolean
+gp_find(GGuillotinePacker *gp,
+        const GRect       *bins,
+        guint              n_bins,
+        GPFit             *best)
+{
+  const gboolean turn = BP_GET_PRIV(gp)->allow_rotation;
+  guint k;
+
+  best->score = G_MAXINT64; /* smaller is better */
+  best->pos = best->idx = 0;
+  best->rotated = FALSE;
+
+  if (gp_exact(gp, bins, n_bins, best))
+    return TRUE;
+
+  if (gp->n_active < GP_INDEX_MIN_FREE)
+    gp_scan(gp, bins, n_bins, best);
+  else
+    for (k = 0; k < n_bins; k++)
+      {
+        GRect t;
+
+        if (bins[k].x != G_RECT_UNPLACED)
+          continue;
+
+        gp_index_query(gp, &bins[k], k, FALSE, best);
+
+        if (!turn || bins[k].width == bins[k].height)
+          continue;
+
+        t = bins[k];
+        bp_rect_turn(&t);
+        gp_index_query(gp, &t, k, TRUE, best);
+      }
+
+  return best->score != G_MAXINT64;
+}
+
+/* put b into the free rect at pos and split what is left of it */
+static void
+gp_place(GGuillotinePacker *gp,
+         guint              pos,
+         GRect             *b)
+{
+  GBinPackerPrivate *base = BP_GET_PRIV(gp);
+  GRect *f = &g_array_index(gp->rects_free, GRect, pos);
+  GRect lt, rl;
+
+  b->x = f->x;
+  b->y = f->y;
+
+  g_rect_guillotine(f, b, &lt, &rl, gp->split_method);
+  gp_free_remove(gp, pos);
+
+  if (g_rect_area_nonzero(&lt))
+    gp_free_release(gp, &lt);
+
+  if (g_rect_area_nonzero(&rl))
+    gp_free_release(gp, &rl);
+
+  bp_rects_append(base, b);
+}
+
+/* place a single rect, r gets its position on success */
+static gboolean
+gp_pack(GGuillotinePacker *gp,
+        GRect             *r)
+{
+  GPFit best;
+
+  r->x = r->y = G_RECT_UNPLACED;
+  r->rotated = FALSE;
+
+  gp_free_seen(gp, r, 1);
+
+  if (!gp_find(gp, r, 1, &best))
+    return FALSE;
+
+  if (best.rotated)
+    bp_rect_turn(r);
+
+  gp_place(gp, best.pos, r);
+  return TRUE;
+}
+
+/* the same with the padding and alignment of the packer */
+gboolean
+g_guillotine_packer_pack(GGuillotinePacker *gp,
+                         GRect             *r)
+{
+  return bp_pack(G_BIN_PACKER(gp), r);
+}
+
+/* best fit first over all the pending rects */
+static guint
+gp_place_pending(GGuillotinePacker *gp,
+                 GRect             *rects,
+                 guint              n_rects,
+                 guint             *order)
+{
+  guint n_placed = 0;
+  GPFit best;
+
+  gp_free_seen(gp, rects, n_rects);
+
+  while (gp_find(gp, rects, n_rects, &best))
+    {
+      if (best.rotated)
+        bp_rect_turn(&rects[best.idx]);
+
+      gp_place(gp, best.pos, &rects[best.idx]);
+      order[n_placed++] = best.idx;
+    }
+
+  return n_placed;
+}
+
+GArray *
+g_guillotine_packer_insert(GGuillotinePacker *gp,
+			   GArray            *bins)
+{
+  return bp_insert(G_BIN_PACKER(gp), bins);
+}
+
+GArray *
+g_guillotine_packer_check(GGuillotinePacker *gp)
+{
+  return g_bin_packer_check(G_BIN_PACKER(gp));
+}
+
+/* ************************************************************************** */
+
+struct _GSkylinePacker {
+  GBinPacker         parent;
+
+  GArray            *skyline;
+  GArray            *window;   /* scratch deque for position_node */
+  guint64            area;     /* below the skyline */
+
+  GSkylinePackerLevel level;
+  gboolean           offline;
+
+  gboolean           use_wm;
+  GGuillotinePacker *wastemap;
+};
+
+enum {
+  PROP_SP_0,
+  PROP_SP_SKYLINE,
+  PROP_SP_USE_WASTEMAP,
+  PROP_SP_LEVEL,
+  PROP_SP_OFFLINE,
+  PROP_SP_LAST
+};
+static GParamSpec *sp_props[PROP_SP_LAST] = { NULL, };
+
+G_DEFINE_TYPE(GSkylinePacker, g_skyline_packer, G_TYPE_BIN_PACKER);
+
+static void
+g_skyline_packer_finalize(GObject *obj)
+{
+  GSkylinePacker *sp = G_SKYLINE_PACKER(obj);
+
+  g_array_free(sp->skyline, TRUE);
+  g_array_free(sp->window, TRUE);
+  g_clear_pointer(&sp->wastemap, g_object_unref);
+
+  G_OBJECT_CLASS(g_skyline_packer_parent_class)->finalize(obj);
+}
+
+static void
+g_skyline_packer_get_property(GObject    *object,
+                                 guint       prop_id,
+                                 GValue     *value,
+                                 GParamSpec *pspec)
+{
+  GSkylinePacker *sp = G_SKYLINE_PACKER(object);
+
+  switch (prop_id) {
+  case PROP_SP_SKYLINE:
+    g_value_set_boxed(value, sp->skyline);
+    break;
+
+  case PROP_SP_USE_WASTEMAP:
+    g_value_set_boolean(value, sp->wastemap != NULL);
+    break;
+
+  case PROP_SP_LEVEL:
+    g_value_set_uint(value, sp->level);
+    break;
+
+  case PROP_SP_OFFLINE:
+    g_value_set_boolean(value, sp->offline);
+    break;
+  }
+}
+
+
+static void
+g_skyline_packer_set_property(GObject      *object,
+                                 guint         prop_id,
+                                 const GValue *value,
+                                 GParamSpec   *pspec)
+{
+  GSkylinePacker *sp = G_SKYLINE_PACKER(object);
+
+  switch (prop_id) {
+  case PROP_SP_USE_WASTEMAP:
+     sp->use_wm = g_value_get_boolean(value);
+    break;
+
+  case PROP_SP_LEVEL:
+    sp->level = g_value_get_uint(value);
+    break;
+
+  case PROP_SP_OFFLINE:
+    sp->offline = g_value_get_boolean(value);
+    break;
+  }
+
+}
+
+
+static void
+g_skyline_packer_constructed(GObject *obj)
+{
+  GSkylinePacker *sp = G_SKYLINE_PACKER(obj);
+  GBinPackerPrivate *priv = BP_GET_PRIV(sp);
+  GRect *r;
+
+  G_OBJECT_CLASS(g_skyline_packer_parent_class)->constructed(obj);
+
+  sp->skyline->len = 1;
+
+  r = &g_array_index(sp->skyline, GRect, 0);
+  r->x = r->y = 0;
+
+  r->width  = priv->width;
+  r->height = 0; //not actually needed
+
+  if (!sp->use_wm)
+    return;
+
+  sp->wastemap = g_object_new(G_TYPE_GUILLOTINE_PACKER,
+                              "width", priv->width,
+                              "height", priv->height,
+                              "allow-rotation", priv->allow_rotation,
+                              NULL);
+
+  BP_GET_PRIV(sp->wastemap)->counters = priv->counters;
+
+  /* it only ever gets the gaps below the skyline */
+  gp_free_remove(sp->wastemap, 0);
+}
+
+static void
+g_skyline_packer_init(GSkylinePacker *sp)
+{
+  sp->skyline = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+  sp->window  = g_array_sized_new(FALSE, FALSE, sizeof(guint), 1);
+}
+
+static GArray *
+g_skyline_packer_insert_bins(GBinPacker *packer,
+                             GArray     *bins)
+{
+  return g_skyline_packer_insert(G_SKYLINE_PACKER(packer), bins);
+}
+
+static gboolean skyline_pack(GSkylinePacker *sp,
+                             GRect          *r);
+
+static gboolean
+g_skyline_packer_pack_rect(GBinPacker *packer,
+                           GRect      *r)
+{
+  return skyline_pack(G_SKYLINE_PACKER(packer), r);
+}
+
+static guint skyline_place_pending(GSkylinePacker *sp,
+                                   GRect          *rects,
+                                   guint           n_rects,
+                                   guint          *order);
+
+static guint
+g_skyline_packer_place_rects(GBinPacker *packer,
+                             GRect      *rects,
+                             guint       n_rects,
+                             guint      *order)
+{
+  return skyline_place_pending(G_SKYLINE_PACKER(packer), rects, n_rects, order);
+}
+
+static void g_skyline_packer_release(GBinPacker  *packer,
+                                     const GRect *rect);
+static void g_skyline_packer_grow(GBinPacker *packer,
+                                  guint       old_width,
+                                  guint       old_height);
+static void g_skyline_packer_save(GBinPacker *packer,
+                                  GByteArray *out);
+static gboolean g_skyline_packer_load(GBinPacker    *packer,
+                                      const guint8 **data,
+                                      gsize         *size);
+static gboolean g_skyline_packer_free_space(GBinPacker *packer,
+                                            GArray     *rects);
+static void g_skyline_packer_stats(GBinPacker      *packer,
+                                   GBinPackerStats *stats);
+
+static void
+g_skyline_packer_class_init(GSkylinePackerClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+  gobject_class->finalize     = g_skyline_packer_finalize;
+  gobject_class->get_property = g_skyline_packer_get_property;
+  gobject_class->set_property = g_skyline_packer_set_property;
+  gobject_class->constructed  = g_skyline_packer_constructed;
+
+  G_BIN_PACKER_CLASS(klass)->release = g_skyline_packer_release;
+  G_BIN_PACKER_CLASS(klass)->grow    = g_skyline_packer_grow;
+  G_BIN_PACKER_CLASS(klass)->insert  = g_skyline_packer_insert_bins;
+  G_BIN_PACKER_CLASS(klass)->pack    = g_skyline_packer_pack_rect;
+  G_BIN_PACKER_CLASS(klass)->place   = g_skyline_packer_place_rects;
+  G_BIN_PACKER_CLASS(klass)->save    = g_skyline_packer_save;
+  G_BIN_PACKER_CLASS(klass)->load    = g_skyline_packer_load;
+  G_BIN_PACKER_CLASS(klass)->free_space = g_skyline_packer_free_space;
+  G_BIN_PACKER_CLASS(klass)->stats   = g_skyline_packer_stats;
+
+  sp_props[PROP_SP_SKYLINE] =
+    g_param_spec_boxed("skyline",
+                       NULL, NULL,
+                       G_TYPE_ARRAY,
+                       G_PARAM_READABLE |
+                       G_PARAM_STATIC_NICK);
+
+  sp_props[PROP_SP_USE_WASTEMAP] =
+    g_param_spec_boolean("use-wastemap",
+                         NULL, NULL, TRUE,
+                         G_PARAM_READWRITE |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_NICK);
+
+  sp_props[PROP_SP_LEVEL] =
+    g_param_spec_uint("level",
+                      NULL, NULL,
+                      GSP_LEVEL_BOTTOM_LEFT,
+                      GSP_LEVEL_MIN_WASTE,
+                      GSP_LEVEL_BOTTOM_LEFT,
+                      G_PARAM_READWRITE |
+                      G_PARAM_CONSTRUCT_ONLY |
+                      G_PARAM_STATIC_NICK);
+
+  sp_props[PROP_SP_OFFLINE] =
+    g_param_spec_boolean("offline",
+                         NULL, NULL, FALSE,
+                         G_PARAM_READWRITE |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_NICK);
+
+  g_object_class_install_properties(gobject_class,
+                                    PROP_SP_LAST,
+                                    sp_props);
+}
+
+/* 64 bit, the area wasted below a rect can pass G_MAXUINT */
+typedef struct Score {
+
+  guint64 first;
+  guint64 second;
+
+} Score;
+
+static gboolean
+score_check_and_update(Score   *score,
+                       guint64  first,
+                       guint64  second)
+{
+  if (!(first < score->first ||
+        (first == score->first && second < score->second)))
+    return FALSE;
+
+  score->first = first;
+  score->second = second;
+
+  return TRUE;
+}
+
+/* find the best position for r. The rect placed at the start of
+   segment i rests on the highest of the segments that start below
+   its right edge; since both ends of that window only ever move
+   right as i grows, the maximum is kept in a monotonic deque
+   (indices of segments with decreasing y), which makes this a
+   single pass over the skyline. The area wasted below r is kept
+   up to date the same way, as a running sum over the window */
+static gboolean
+position_node(GSkylinePacker *sp,
+              GRect          *r,
+              guint          *index,
+              Score          *score)
+{
+  GBinPackerPrivate *base = BP_GET_PRIV(sp);
+  const guint len = sp->skyline->len;
+  const GRect *sky = (const GRect *) sp->skyline->data;
+  guint head = 0, tail = 0;
+  gboolean have_fit = FALSE;
+  guint64 below = 0;  /* sum of y * width over [i, j) */
+  guint n_scored = 0;
+  guint *dq;
+  guint i, j;
+
+  score->first = G_MAXUINT64;
+  score->second = G_MAXUINT64;
+
+  g_array_set_size(sp->window, len);
+  dq = (guint *) sp->window->data;
+
+  for (i = 0, j = 0; i < len; i++)
+    {
+      const GRect *n = &sky[i];
+      const guint right = n->x + r->width;
+      const GRect *last;
+      guint64 waste;
+      guint top;
+      guint y;
+
+      if (i > 0)
+        below -= (guint64) sky[i - 1].y * sky[i - 1].width;
+
+      if (right > base->width)
+        break; /* and so will every segment further right */
+
+      while (head < tail && dq[head] < i)
+        head++;
+
+      /* [i, j) are the segments below r */
+      for (; j < len && (j <= i || sky[j].x < right); j++)
+        {
+          while (head < tail && sky[dq[tail - 1]].y <= sky[j].y)
+            tail--;
+
+          dq[tail++] = j;
+          below += (guint64) sky[j].y * sky[j].width;
+        }
+
+      y = sky[dq[head]].y;
+
+      if (y + r->height > base->height)
+        continue;
+
+      top = y + r->height;
+      n_scored++;
+
+      switch (sp->level)
+        {
+        case GSP_LEVEL_MIN_WASTE:
+          /* the last segment is only partly covered */
+          last = &sky[j - 1];
+          waste = (guint64) y * r->width - below +
+                  (guint64) last->y * (last->x + last->width - right);
+
+          if (!score_check_and_update(score, waste, top))
+            continue;
+          break;
+
+        case GSP_LEVEL_BOTTOM_LEFT:
+        default:
+          if (!score_check_and_update(score, top, n->width))
+            continue;
+          break;
+        }
+
+      r->x = n->x;
+      r->y = y;
+
+      *index = i;
+      have_fit = TRUE;
+    }
+
+  BP_COUNT(base, scored, n_scored);
+  BP_COUNT(base, segments, j);
+
+  return have_fit;
+}
+
+/* position_node for r as given and, if rotation is allowed, turned;
+   the turned one has to be strictly better to be taken */
+static gboolean
+skyline_position(GSkylinePacker *sp,
+                 GRect          *r,
+                 guint          *index,
+                 Score          *score)
+{
+  gboolean have_fit = position_node(sp, r, index, score);
+  GRect t = *r;
+  Score s;
+  guint idx;
+
+  if (!BP_GET_PRIV(sp)->allow_rotation || r->width == r->height)
+    return have_fit;
+
+  bp_rect_turn(&t);
+
+  if (!position_node(sp, &t, &idx, &s) ||
+      !score_check_and_update(score, s.first, s.second))
+    return have_fit;
+
+  *r = t;
+  *index = idx;
+
+  return TRUE;
+}
+
+/* hand the gaps between r (placed at segment pos) and the
+   segments below it to the waste map */
+static void
+skyline_add_waste(GSkylinePacker *sp,
+                  const GRect    *r,
+                  guint           pos)
+{
+  const guint right = r->x + r->width;
+  guint i;
+
+  for (i = pos; i < sp->skyline->len; i++)
+    {
+      const GRect *n = &g_array_index(sp->skyline, GRect, i);
+      GRect w = {0, };
+
+      if (n->x >= right)
+        break;
+
+      if (n->y == r->y)
+        continue;
+
+      w.x = n->x;
+      w.y = n->y;
+      w.width = MIN(right, n->x + n->width) - n->x;
+      w.height = r->y - n->y;
+
+      gp_free_release(sp->wastemap, &w);
+    }
+}
+
+/* replace the segments [i, j) by parts, merging them with each
+   other and with the neighbours at the same height, with a single
+   move of the segments behind */
+static void
+skyline_splice(GSkylinePacker *sp,
+               guint           i,
+               guint           j,
+               const GRect    *parts,
+               guint           n_parts)
+{
+  const guint len = sp->skyline->len;
+  GRect *sky = (GRect *) sp->skyline->data;
+  GRect merged[5];
+  guint n = 0, k;
+
+  if (i > 0 && sky[i - 1].y == parts[0].y)
+    merged[n++] = sky[--i];
+
+  for (k = 0; k < n_parts; k++)
+    {
+      if (n > 0 && merged[n - 1].y == parts[k].y)
+        merged[n - 1].width += parts[k].width;
+      else
+        merged[n++] = parts[k];
+    }
+
+  if (j < len && sky[j].y == merged[n - 1].y)
+    merged[n - 1].width += sky[j++].width;
+
+  for (k = i; k < j; k++)
+    sp->area -= (guint64) sky[k].width * sky[k].y;
+
+  for (k = 0; k < n; k++)
+    sp->area += (guint64) merged[k].width * merged[k].y;
+
+  if (n > j - i)
+    g_array_set_size(sp->skyline, len + n - (j - i));
+
+  sky = (GRect *) sp->skyline->data;
+  memmove(&sky[i + n], &sky[j], (len - j) * sizeof(GRect));
+  memcpy(&sky[i], merged, n * sizeof(GRect));
+
+  if (n < j - i)
+    g_array_set_size(sp->skyline, len + n - (j - i));
+}
+
+/* index of the segment x lies on */
+static guint
+skyline_find(GSkylinePacker *sp,
+             guint           x)
+{
+  const GRect *sky = (const GRect *) sp->skyline->data;
+  guint lo = 0, hi = sp->skyline->len;
+
+  while (hi - lo > 1)
+    {
+      const guint mid = lo + (hi - lo) / 2;
+
+      if (sky[mid].x <= x)
+        lo = mid;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+static void
+skyline_add_level(GSkylinePacker *sp,
+                  const GRect    *r,
+                  guint           pos)
+{
+  GBinPackerPrivate *base = BP_GET_PRIV(sp);
+  const GRect *sky = (const GRect *) sp->skyline->data;
+  const guint right = r->x + r->width;
+  GRect parts[2] = {{0, }, };
+  guint n_parts = 1;
+  guint j;
+
+  parts[0].x = r->x;
+  parts[0].y = r->y + r->height;
+  parts[0].width = r->width;
+
+  g_assert(right <= base->width);
+  g_assert(parts[0].y <= base->height);
+
+  /* [pos, j) are below r, the last one maybe only in part */
+  for (j = pos; j < sp->skyline->len && sky[j].x < right; j++)
+    ;
+
+  if (sky[j - 1].x + sky[j - 1].width > right)
+    {
+      parts[n_parts] = sky[j - 1];
+      parts[n_parts].x = right;
+      parts[n_parts++].width = sky[j - 1].x + sky[j - 1].width - right;
+    }
+
+  skyline_splice(sp, pos, j, parts, n_parts);
+}
+
+/* lower the skyline below r again, if r is what it rests on */
+static gboolean
+skyline_lower(GSkylinePacker *sp,
+              const GRect    *r)
+{
+  const guint top = r->y + r->height;
+  const guint right = r->x + r->width;
+  GRect *sky = (GRect *) sp->skyline->data;
+  GRect parts[3];
+  guint n_parts = 0;
+  guint i, j;
+
+  i = skyline_find(sp, r->x);
+
+  for (j = i; j < sp->skyline->len && sky[j].x < right; j++)
+    if (sky[j].y != top)
+      return FALSE; /* something is on top of it */
+
+  if (i == j)
+    return FALSE;
+
+  if (sky[i].x < r->x)
+    {
+      parts[n_parts] = sky[i];
+      parts[n_parts++].width = r->x - sky[i].x;
+    }
+
+  parts[n_parts] = *r;
+  parts[n_parts].height = 0;
+  n_parts++;
+
+  if (sky[j - 1].x + sky[j - 1].width > right)
+    {
+      parts[n_parts] = sky[j - 1];
+      parts[n_parts].x = right;
+      parts[n_parts++].width = sky[j - 1].x + sky[j - 1].width - right;
+    }
+
+  skyline_splice(sp, i, j, parts, n_parts);
+  return TRUE;
+}
+
+static void
+skyline_place(GSkylinePacker *sp,
+              const GRect    *r,
+              guint           pos)
+{
+  GBinPackerPrivate *base = BP_GET_PRIV(sp);
+
+  if (sp->wastemap)
+    skyline_add_waste(sp, r, pos);
+
+  skyline_add_level(sp, r, pos);
+  bp_rects_append(base, r);
+}
+
+/* place a single rect, r gets its position on success */
+static gboolean
+skyline_pack(GSkylinePacker *sp,
+             GRect          *r)
+{
+  GBinPackerPrivate *base = BP_GET_PRIV(sp);
+  Score score;
+  guint pos;
+
+  r->rotated = FALSE;
+
+  if (sp->wastemap && gp_pack(sp->wastemap, r))
+    {
+      bp_rects_append(base, r);
+      return TRUE;
+    }
+
+  if (!skyline_position(sp, r, &pos, &score))
+    {
+      r->x = r->y = G_RECT_UNPLACED;
+      return FALSE;
+    }
+
+  skyline_place(sp, r, pos);
+  return TRUE;
+}
+
+/* the same with the padding and alignment of the packer */
+gboolean
+g_skyline_packer_pack(GSkylinePacker *sp,
+                      GRect          *r)
+{
+  return bp_pack(G_BIN_PACKER(sp), r);
+}
+
+/* stable LSD radix sort of the indices in idx by keys[idx[i]],
+   largest key first; passes where all keys share the digit are
+   skipped, which for pixel sizes are all but one or two */
+static void
+radix_sort_desc(guint       *idx,
+                guint       *tmp,
+                const guint *keys,
+                guint        n)
+{
+  guint *src = idx;
+  guint *dst = tmp;
+  guint shift;
+
+  for (shift = 0; shift < 32; shift += 8)
+    {
+      guint count[257] = {0, };
+      guint *t;
+      guint i;
+
+      for (i = 0; i < n; i++)
+        count[0xff - ((keys[src[i]] >> shift) & 0xff) + 1]++;
+
+      for (i = 1; i < 257 && count[i] != n; i++)
+        ;
+
+      if (i < 257)
+        continue;
+
+      for (i = 1; i < 257; i++)
+        count[i] += count[i - 1];
+
+      for (i = 0; i < n; i++)
+        {
+          const guint d = 0xff - ((keys[src[i]] >> shift) & 0xff);
+          dst[count[d]++] = src[i];
+        }
+
+      t = src;
+      src = dst;
+      dst = t;
+    }
+
+  if (src != idx)
+    memcpy(idx, src, n * sizeof(guint));
+}
+
+/* place all bins in one pass, tallest (then widest) first,
+   instead of searching for the globally best bin every round */
+static guint
+skyline_place_offline(GSkylinePacker *sp,
+                      GRect          *rects,
+                      guint           n_rects,
+                      guint          *order)
+{
+  guint *keys, *sorted, *tmp;
+  guint i, n = 0, n_placed = 0;
+
+  keys = g_new0(guint, n_rects);
+  sorted = g_new0(guint, n_rects);
+  tmp = g_new0(guint, n_rects);
+
+  for (i = 0; i < n_rects; i++)
+    if (rects[i].x == G_RECT_UNPLACED)
+      sorted[n++] = i;
+
+  for (i = 0; i < n_rects; i++)
+    keys[i] = rects[i].width;
+
+  radix_sort_desc(sorted, tmp, keys, n);
+
+  for (i = 0; i < n_rects; i++)
+    keys[i] = rects[i].height;
+
+  radix_sort_desc(sorted, tmp, keys, n);
+
+  for (i = 0; i < n; i++)
+    if (skyline_pack(sp, &rects[sorted[i]]))
+      order[n_placed++] = sorted[i];
+
+  g_free(tmp);
+  g_free(sorted);
+  g_free(keys);
+
+  return n_placed;
+}
+
+/* best bin first, the gaps below the skyline before the skyline */
+static guint
+skyline_place_pending(GSkylinePacker *sp,
+                      GRect          *rects,
+                      guint           n_rects,
+                      guint          *order)
+{
+  GBinPackerPrivate *base = BP_GET_PRIV(sp);
+  guint n_placed = 0;
+
+  if (sp->offline)
+    return skyline_place_offline(sp, rects, n_rects, order);
+
+  for (;;)
+    {
+      gboolean have_fit = FALSE;
+      Score score = {G_MAXUINT64, G_MAXUINT64};
+      GRect best;
+      guint best_skyline;
+      guint best_bin;
+      guint i;
+
+      if (sp->wastemap)
+        {
+          guint n = gp_place_pending(sp->wastemap, rects, n_rects,
+                                     order + n_placed);
+
+          for (i = 0; i < n; i++)
+            bp_rects_append(base, &rects[order[n_placed++]]);
+        }
+
+      for (i = 0; i < n_rects; i++)
+        {
+          GRect t = rects[i];
+          Score s;
+          guint idx;
+
+          if (t.x != G_RECT_UNPLACED)
+            continue;
+
+          if (!skyline_position(sp, &t, &idx, &s) ||
+              !score_check_and_update(&score, s.first, s.second))
+              continue;
+
+          best = t;
+          best_skyline = idx;
+          best_bin = i;
+          have_fit = TRUE;
+        }
+
+      if (!have_fit)
+        break;
+
+      skyline_place(sp, &best, best_skyline);
+
+      rects[best_bin] = best;
+      order[n_placed++] = best_bin;
+    }
+
+  return n_placed;
+}
+
+GArray *
+g_skyline_packer_insert(GSkylinePacker *sp,
+                        GArray         *bins)
+{
+  return bp_insert(G_BIN_PACKER(sp), bins);
+}
+
+/* free rects of the waste map that the skyline rests on go back
+   to it, as far as they are under a single segment, until there
+   are none left; what is left of them to the sides stays */
+static void
+skyline_reclaim(GSkylinePacker *sp)
+{
+  GGuillotinePacker *wm = sp->wastemap;
+  guint i = 0;
+
+  while (i < wm->rects_free->len)
+    {
+      const GRect f = g_array_index(wm->rects_free, GRect, i);
+      const GRect *sky = (const GRect *) sp->skyline->data;
+      const guint right = f.x + f.width;
+      GRect part = f, side = f;
+      guint k;
+
+      for (k = skyline_find(sp, f.x);
+           k < sp->skyline->len && sky[k].x < right; k++)
+        if (sky[k].y == f.y + f.height)
+          break;
+
+      if (k == sp->skyline->len || sky[k].x >= right)
+        {
+          i++;
+          continue;
+        }
+
+      part.x = MAX(f.x, sky[k].x);
+      part.width = MIN(right, sky[k].x + sky[k].width) - part.x;
+
+      gp_free_remove(wm, i);
+      skyline_lower(sp, &part);
+
+      if (part.x > f.x)
+        {
+          side.width = part.x - f.x;
+          gp_free_release(wm, &side);
+        }
+
+      if (part.x + part.width < right)
+        {
+          side.x = part.x + part.width;
+          side.width = right - side.x;
+          gp_free_release(wm, &side);
+        }
+
+      /* the merges may have moved anything */
+      i = 0;
+    }
+}
+
+/* back to a flat skyline and an empty waste map */
+static void
+skyline_reset(GSkylinePacker *sp)
+{
+  GBinPackerPrivate *priv = BP_GET_PRIV(sp);
+  GBinPackerPrivate *wm;
+  GRect r = {0, };
+
+  r.width = priv->width;
+  skyline_splice(sp, 0, sp->skyline->len, &r, 1);
+
+  if (sp->wastemap == NULL)
+    return;
+
+  wm = BP_GET_PRIV(sp->wastemap);
+  while (bp_rects_len(wm) > 0)
+    bp_rects_remove(wm, bp_rects_len(wm) - 1);
+
+  while (sp->wastemap->rects_free->len > 0)
+    gp_free_remove(sp->wastemap, sp->wastemap->rects_free->len - 1);
+}
+
+/* the space of a rect that the skyline rests on goes back to
+   the skyline, anything below goes to the waste map, from which
+   it rejoins the skyline once that comes down to it; without
+   one it is lost until the last rect is gone */
+static void
+g_skyline_packer_release(GBinPacker  *packer,
+                         const GRect *rect)
+{
+  GSkylinePacker *sp = G_SKYLINE_PACKER(packer);
+  GBinPackerPrivate *wm;
+  guint i;
+
+  if (bp_rects_len(BP_GET_PRIV(sp)) == 0)
+    {
+      skyline_reset(sp);
+      return;
+    }
+
+  if (sp->wastemap == NULL)
+    {
+      skyline_lower(sp, rect);
+      return;
+    }
+
+  /* it might have been packed into the waste map in the first
+     place, even if its top has become the skyline since; only with
+     rects sharing its id does that take a scan */
+  wm = BP_GET_PRIV(sp->wastemap);
+  i = bp_rects_find(wm, rect->id);
+
+  if (i != G_MAXUINT)
+    {
+      GRect r;
+
+      bp_rects_get(wm, i, &r);
+
+      if (r.x != rect->x || r.y != rect->y)
+        for (i = bp_rects_len(wm); i-- > 0; )
+          {
+            bp_rects_get(wm, i, &r);
+
+            if (r.x == rect->x && r.y == rect->y)
+              break;
+          }
+
+      if (i != G_MAXUINT)
+        bp_rects_remove(wm, i);
+    }
+
+  gp_free_release(sp->wastemap, rect);
+  skyline_reclaim(sp);
+}
+
+/* nothing is above the skyline, so a taller atlas needs nothing
+   and a wider one just a new level at the bottom on the right */
+static void
+g_skyline_packer_grow(GBinPacker *packer,
+                      guint       old_width,
+                      guint       old_height)
+{
+  GSkylinePacker *sp = G_SKYLINE_PACKER(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(sp);
+  GRect r = {0, };
+
+  if (sp->wastemap)
+    {
+      /* only ever holds the gaps below the skyline */
+      GBinPackerPrivate *wm = BP_GET_PRIV(sp->wastemap);
+
+      wm->width = priv->width;
+      wm->height = priv->height;
+    }
+
+  if (priv->width == old_width)
+    return;
+
+  r.x = old_width;
+  r.width = priv->width - old_width;
+
+  skyline_splice(sp, sp->skyline->len, sp->skyline->len, &r, 1);
+}
+
+/* the skyline, and the waste map with it if there is one */
+static void
+g_skyline_packer_save(GBinPacker *packer,
+                      GByteArray *out)
+{
+  GSkylinePacker *sp = G_SKYLINE_PACKER(packer);
+
+  bp_write_rects(out, sp->skyline);
+
+  if (sp->wastemap == NULL)
+    return;
+
+  bp_write_packed(BP_GET_PRIV(sp->wastemap), out);
+  g_guillotine_packer_save(G_BIN_PACKER(sp->wastemap), out);
+}
+
+static gboolean
+g_skyline_packer_load(GBinPacker    *packer,
+                      const guint8 **data,
+                      gsize         *size)
+{
+  GSkylinePacker *sp = G_SKYLINE_PACKER(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(sp);
+  guint x = 0;
+  guint i;
+
+  if (!bp_read_rects(data, size, sp->skyline) || sp->skyline->len == 0)
+    return FALSE;
+
+  sp->area = 0;
+
+  /* the segments have to cover the width without gaps */
+  for (i = 0; i < sp->skyline->len; i++)
+    {
+      const GRect *n = &g_array_index(sp->skyline, GRect, i);
+
+      if (n->x != x || n->width == 0 || n->width > priv->width - x ||
+          n->y > priv->height)
+        return FALSE;
+
+      x += n->width;
+      sp->area += (guint64) n->width * n->y;
+    }
+
+  if (x != priv->width)
+    return FALSE;
+
+  if (sp->wastemap == NULL)
+    return TRUE;
+
+  return bp_read_packed(BP_GET_PRIV(sp->wastemap), data, size) &&
+         g_guillotine_packer_load(G_BIN_PACKER(sp->wastemap), data, size);
+}
+
+/* everything above the skyline, and the free part of the waste
+   below it */
+static gboolean
+g_skyline_packer_free_space(GBinPacker *packer,
+                            GArray     *rects)
+{
+  GSkylinePacker *sp = G_SKYLINE_PACKER(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(sp);
+  guint i;
+
+  for (i = 0; i < sp->skyline->len; i++)
+    {
+      GRect r = g_array_index(sp->skyline, GRect, i);
+
+      if (r.y >= priv->height)
+        continue;
+
+      r.height = priv->height - r.y;
+      g_array_append_val(rects, r);
+    }
+
+  if (sp->wastemap)
+    g_guillotine_packer_free_space(G_BIN_PACKER(sp->wastemap), rects);
+
+  return TRUE;
+}
+
+/* everything below the skyline is either packed or wasted, some
+   of the waste may still be in the waste map */
+static void
+g_skyline_packer_stats(GBinPacker      *packer,
+                       GBinPackerStats *stats)
+{
+  GSkylinePacker *sp = G_SKYLINE_PACKER(packer);
+
+  stats->n_segments = sp->skyline->len;
+  stats->waste_area = sp->area - MIN(sp->area, stats->used_area);
+
+  if (sp->wastemap)
+    g_guillotine_packer_stats(G_BIN_PACKER(sp->wastemap), stats);
+}
+
+/* ************************************************************************** */
+
+struct _GMaxRectsPacker {
+  GBinPacker parent;
+
+  /* maximal free rects, they may overlap each other but
+     none of them is contained in another one */
+  GArray    *rects_free;
+  GArray    *free_w;     /* the sizes of rects_free for the scan */
+  GArray    *free_h;
+  GArray    *fresh;      /* scratch for mp_split_free_rects */
+  GArray    *split;      /* ditto */
+  GRect      largest;    /* of rects_free, by area */
+
+  GRectFit   fit_method;
+};
+
+enum {
+  PROP_MP_0,
+  PROP_MP_FREE_RECTS,
+  PROP_MP_FIT_METHOD,
+  PROP_MP_LAST
+};
+static GParamSpec *mp_props[PROP_MP_LAST] = { NULL, };
+
+G_DEFINE_TYPE(GMaxRectsPacker, g_max_rects_packer, G_TYPE_BIN_PACKER);
+
+/* bring free_w, free_h and largest up to date with rects_free
+   from pos on */
+static void
+mp_free_sizes_sync(GMaxRectsPacker *mp,
+                   guint            pos)
+{
+  GArray *rf = mp->rects_free;
+  guint i;
+
+  g_array_set_size(mp->free_w, rf->len);
+  g_array_set_size(mp->free_h, rf->len);
+
+  if (pos == 0)
+    memset(&mp->largest, 0, sizeof(GRect));
+
+  for (i = pos; i < rf->len; i++)
+    {
+      const GRect *r = &g_array_index(rf, GRect, i);
+
+      g_array_index(mp->free_w, guint, i) = r->width;
+      g_array_index(mp->free_h, guint, i) = r->height;
+
+      if (bp_rect_larger(r, &mp->largest))
+        mp->largest = *r;
+    }
+}
+
+static void
+g_max_rects_packer_finalize(GObject *obj)
+{
+  GMaxRectsPacker *mp = G_MAX_RECTS_PACKER(obj);
+
+  g_array_free(mp->rects_free, TRUE);
+  g_array_free(mp->free_w, TRUE);
+  g_array_free(mp->free_h, TRUE);
+  g_array_free(mp->fresh, TRUE);
+  g_array_free(mp->split, TRUE);
+
+  G_OBJECT_CLASS(g_max_rects_packer_parent_class)->finalize(obj);
+}
+
+static void
+g_max_rects_packer_get_property(GObject    *object,
+                                guint       prop_id,
+                                GValue     *value,
+                                GParamSpec *pspec)
+{
+  GMaxRectsPacker *mp = G_MAX_RECTS_PACKER(object);
+
+  switch (prop_id) {
+  case PROP_MP_FREE_RECTS:
+    g_value_set_boxed(value, mp->rects_free);
+    break;
+
+  case PROP_MP_FIT_METHOD:
+    g_value_set_uint(value, mp->fit_method);
+    break;
+  }
+}
+
+static void
+g_max_rects_packer_set_property(GObject      *object,
+                                guint         prop_id,
+                                const GValue *value,
+                                GParamSpec   *pspec)
+{
+  GMaxRectsPacker *mp = G_MAX_RECTS_PACKER(object);
+
+  switch (prop_id) {
+  case PROP_MP_FIT_METHOD:
+    mp->fit_method = g_value_get_uint(value);
+    break;
+  }
+}
+
+static void
+g_max_rects_packer_constructed(GObject *obj)
+{
+  GMaxRectsPacker *mp = G_MAX_RECTS_PACKER(obj);
+  GBinPackerPrivate *priv = BP_GET_PRIV(mp);
+  GRect r = {0, };
+
+  G_OBJECT_CLASS(g_max_rects_packer_parent_class)->constructed(obj);
+
+  r.width  = priv->width;
+  r.height = priv->height;
+
+  g_array_append_val(mp->rects_free, r);
+  mp_free_sizes_sync(mp, 0);
+}
+
+static void
+g_max_rects_packer_init(GMaxRectsPacker *mp)
+{
+  mp->rects_free = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+  mp->free_w = g_array_sized_new(FALSE, FALSE, sizeof(guint), 1);
+  mp->free_h = g_array_sized_new(FALSE, FALSE, sizeof(guint), 1);
+  mp->fresh = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 4);
+  mp->split = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 4);
+  mp->fit_method = G_RECT_FIT_SHORT_SIDE_BEST;
+}
+
+static GArray *
+g_max_rects_packer_insert_bins(GBinPacker *packer,
+                               GArray     *bins)
+{
+  return g_max_rects_packer_insert(G_MAX_RECTS_PACKER(packer), bins);
+}
+
+static gboolean mp_pack(GMaxRectsPacker *mp,
+                        GRect           *r);
+
+static gboolean
+g_max_rects_packer_pack_rect(GBinPacker *packer,
+                             GRect      *r)
+{
+  return mp_pack(G_MAX_RECTS_PACKER(packer), r);
+}
+
+static guint mp_place_pending(GMaxRectsPacker *mp,
+                              GRect           *rects,
+                              guint            n_rects,
+                              guint           *order);
+
+static guint
+g_max_rects_packer_place_rects(GBinPacker *packer,
+                               GRect      *rects,
+                               guint       n_rects,
+                               guint      *order)
+{
+  return mp_place_pending(G_MAX_RECTS_PACKER(packer), rects, n_rects, order);
+}
+
+static void g_max_rects_packer_release(GBinPacker  *packer,
+                                       const GRect *rect);
+static void g_max_rects_packer_grow(GBinPacker *packer,
+                                    guint       old_width,
+                                    guint       old_height);
+static void g_max_rects_packer_save(GBinPacker *packer,
+                                    GByteArray *out);
+static gboolean g_max_rects_packer_load(GBinPacker    *packer,
+                                        const guint8 **data,
+                                        gsize         *size);
+static gboolean g_max_rects_packer_free_space(GBinPacker *packer,
+                                              GArray     *rects);
+static void g_max_rects_packer_stats(GBinPacker      *packer,
+                                     GBinPackerStats *stats);
+
+static void
+g_max_rects_packer_class_init(GMaxRectsPackerClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+  gobject_class->finalize     = g_max_rects_packer_finalize;
+  gobject_class->get_property = g_max_rects_packer_get_property;
+  gobject_class->set_property = g_max_rects_packer_set_property;
+  gobject_class->constructed  = g_max_rects_packer_constructed;
+
+  G_BIN_PACKER_CLASS(klass)->release = g_max_rects_packer_release;
+  G_BIN_PACKER_CLASS(klass)->grow    = g_max_rects_packer_grow;
+  G_BIN_PACKER_CLASS(klass)->insert  = g_max_rects_packer_insert_bins;
+  G_BIN_PACKER_CLASS(klass)->pack    = g_max_rects_packer_pack_rect;
+  G_BIN_PACKER_CLASS(klass)->place   = g_max_rects_packer_place_rects;
+  G_BIN_PACKER_CLASS(klass)->save    = g_max_rects_packer_save;
+  G_BIN_PACKER_CLASS(klass)->load    = g_max_rects_packer_load;
+  G_BIN_PACKER_CLASS(klass)->free_space = g_max_rects_packer_free_space;
+  G_BIN_PACKER_CLASS(klass)->stats   = g_max_rects_packer_stats;
+
+  rect_scan_resolve();
+
+  mp_props[PROP_MP_FREE_RECTS] =
+    g_param_spec_boxed("free-rects",
+                       NULL, NULL,
+                       G_TYPE_ARRAY,
+                       G_PARAM_READABLE |
+                       G_PARAM_STATIC_NICK);
+
+  mp_props[PROP_MP_FIT_METHOD] =
+    g_param_spec_uint("fit-method",
+                      NULL, NULL,
+                      G_RECT_FIT_AREA_BEST,
                       G_RECT_FIT_LONG_SIDE_WORST,
                       G_RECT_FIT_SHORT_SIDE_BEST,
                       G_PARAM_READWRITE |
                       G_PARAM_CONSTRUCT_ONLY |
                       G_PARAM_STATIC_NICK);
 
-    gp_props[PROP_GP_SPLIT_METHOD] =
-    g_param_spec_uint("split-method",
-                      NULL, NULL,
-                      G_RECT_SPLIT_AREA_MAX,
-                      G_RECT_SPLIT_AREA_MIN,
-                      G_RECT_SPLIT_AREA_MAX,
-                      G_PARAM_READWRITE |
-                      G_PARAM_CONSTRUCT_ONLY |
-                      G_PARAM_STATIC_NICK);
+  g_object_class_install_properties(gobject_class,
+                                    PROP_MP_LAST,
+                                    mp_props);
+}
+
+static inline gboolean
+mp_rect_contains(const GRect *o,
+                 const GRect *i)
+{
+  return i->x >= o->x && i->x + i->width  <= o->x + o->width &&
+         i->y >= o->y && i->y + i->height <= o->y + o->height;
+}
+
+/* add r to the new free rects unless it is contained in one of
+   them or in one of the first n_old free rects, dropping the new
+   ones it contains. The old ones never need to go: a new rect is
+   a part of a free rect that just got split, and the old ones
+   were not contained in that */
+static void
+mp_add_fresh(GMaxRectsPacker *mp,
+             const GRect     *r,
+             guint            n_old)
+{
+  guint i;
+
+  for (i = 0; i < n_old; i++)
+    if (mp_rect_contains(&g_array_index(mp->rects_free, GRect, i), r))
+      return;
+
+  for (i = 0; i < mp->fresh->len; i++)
+    {
+      const GRect *f = &g_array_index(mp->fresh, GRect, i);
+
+      if (mp_rect_contains(f, r))
+        return;
+
+      if (mp_rect_contains(r, f))
+        g_array_remove_index_fast(mp->fresh, i--);
+    }
+
+  g_array_append_vals(mp->fresh, r, 1);
+}
+
+/* replace every free rect that overlaps used by the (up to four)
+   maximal rects that remain of it */
+static void
+mp_split_free_rects(GMaxRectsPacker *mp,
+                    const GRect     *used)
+{
+  GArray *rf = mp->rects_free;
+  const guint ur = used->x + used->width;
+  const guint ub = used->y + used->height;
+  GArray *split = mp->split;
+  guint n_old = 0;
+  guint i;
+
+  g_array_set_size(split, 0);
+  memset(&mp->largest, 0, sizeof(GRect));
+
+  /* keep the untouched ones at the front */
+  for (i = 0; i < rf->len; i++)
+    {
+      const GRect f = g_array_index(rf, GRect, i);
+
+      if (!g_rect_intersect(&f, used, NULL))
+        {
+          if (bp_rect_larger(&f, &mp->largest))
+            mp->largest = f;
+
+          g_array_index(mp->free_w, guint, n_old) = f.width;
+          g_array_index(mp->free_h, guint, n_old) = f.height;
+          g_array_index(rf, GRect, n_old++) = f;
+          continue;
+        }
+
+      g_array_append_val(split, f);
+    }
+
+  g_array_set_size(rf, n_old);
+  g_array_set_size(mp->fresh, 0);
+
+  for (i = 0; i < split->len; i++)
+    {
+      const GRect *f = &g_array_index(split, GRect, i);
+      const guint fr = f->x + f->width;
+      const guint fb = f->y + f->height;
+      GRect n = *f;
+
+      if (used->x > f->x)
+        {
+          n.width = used->x - f->x;
+          mp_add_fresh(mp, &n, n_old);
+          n.width = f->width;
+        }
+
+      if (ur < fr)
+        {
+          n.x = ur;
+          n.width = fr - ur;
+          mp_add_fresh(mp, &n, n_old);
+          n.x = f->x;
+          n.width = f->width;
+        }
+
+      if (used->y > f->y)
+        {
+          n.height = used->y - f->y;
+          mp_add_fresh(mp, &n, n_old);
+          n.height = f->height;
+        }
+
+      if (ub < fb)
+        {
+          n.y = ub;
+          n.height = fb - ub;
+          mp_add_fresh(mp, &n, n_old);
+        }
+    }
+
+  g_array_append_vals(rf, mp->fresh->data, mp->fresh->len);
+  mp_free_sizes_sync(mp, n_old);
+}
+
+/* best free rect and bin out of the n_bins still at G_RECT_UNPLACED,
+   an exact match ends the search. With rotation allowed each bin is
+   also tried turned, right after it is tried upright. The lowest
+   score wins, then the lowest free rect position; on a full tie the
+   one tried first stays, so earlier bins and upright ones win */
+static gboolean
+mp_find(GMaxRectsPacker *mp,
+        const GRect     *bins,
+        guint            n_bins,
+        guint           *best_free,
+        guint           *best_bin,
+        gboolean        *best_rotated)
+{
+  GBinPackerPrivate *base = BP_GET_PRIV(mp);
+  const guint n_turns = base->allow_rotation ? 2 : 1;
+  const guint *fw = (const guint *) mp->free_w->data;
+  const guint *fh = (const guint *) mp->free_h->data;
+  gint best_score = G_MAXINT;
+  gboolean have_fit = FALSE;
+  guint k, t;
+
+  for (k = 0; k < n_bins; k++)
+    {
+      const GRect *b = &bins[k];
+
+      if (b->x != G_RECT_UNPLACED)
+        continue;
+
+      for (t = 0; t < n_turns; t++)
+        {
+          guint n = mp->rects_free->len;
+          guint pos;
+          gint score;
+
+          if (t == 1 && b->width == b->height)
+            break;
+
+          /* past an exact match nothing can beat it */
+          if (best_score == G_MININT)
+            n = *best_free;
+
+          if (t == 0)
+            rect_scan(fw, fh, n, b->width, b->height, mp->fit_method,
+                      &score, &pos);
+          else
+            rect_scan(fw, fh, n, b->height, b->width, mp->fit_method,
+                      &score, &pos);
+
+          BP_COUNT(base, scored, n);
+
+          if (pos == G_MAXUINT || score > best_score ||
+              (score == best_score && (!have_fit || pos >= *best_free)))
+            continue;
+
+          best_score = score;
+          *best_free = pos;
+          *best_bin = k;
+          *best_rotated = t == 1;
+          have_fit = TRUE;
+        }
+    }
+
+  return have_fit;
+}
+
+static void
+mp_place(GMaxRectsPacker *mp,
+         guint            pos,
+         GRect           *r)
+{
+  GBinPackerPrivate *base = BP_GET_PRIV(mp);
+
+  r->x = g_array_index(mp->rects_free, GRect, pos).x;
+  r->y = g_array_index(mp->rects_free, GRect, pos).y;
+
+  mp_split_free_rects(mp, r);
+
+  bp_rects_append(base, r);
+}
+
+/* place a single rect, r gets its position on success */
+static gboolean
+mp_pack(GMaxRectsPacker *mp,
+        GRect           *r)
+{
+  guint best_free = 0, best_bin = 0;
+  gboolean rotated = FALSE;
+
+  r->x = r->y = G_RECT_UNPLACED;
+  r->rotated = FALSE;
+
+  if (!mp_find(mp, r, 1, &best_free, &best_bin, &rotated))
+    return FALSE;
+
+  if (rotated)
+    bp_rect_turn(r);
+
+  mp_place(mp, best_free, r);
+  return TRUE;
+}
+
+/* the same with the padding and alignment of the packer */
+gboolean
+g_max_rects_packer_pack(GMaxRectsPacker *mp,
+                        GRect           *r)
+{
+  return bp_pack(G_BIN_PACKER(mp), r);
+}
+
+static guint
+mp_place_pending(GMaxRectsPacker *mp,
+                 GRect           *rects,
+                 guint            n_rects,
+                 guint           *order)
+{
+  guint best_free = 0, best_bin = 0;
+  gboolean rotated = FALSE;
+  guint n_placed = 0;
+
+  while (mp_find(mp, rects, n_rects, &best_free, &best_bin, &rotated))
+    {
+      if (rotated)
+        bp_rect_turn(&rects[best_bin]);
+
+      mp_place(mp, best_free, &rects[best_bin]);
+      order[n_placed++] = best_bin;
+    }
+
+  return n_placed;
+}
+
+GArray *
+g_max_rects_packer_insert(GMaxRectsPacker *mp,
+                          GArray          *bins)
+{
+  return bp_insert(G_BIN_PACKER(mp), bins);
+}
 
-  g_object_class_install_properties(gobject_class,
-                                    PROP_GP_LAST,
-                                    gp_props);
+GArray *
+g_max_rects_packer_check(GMaxRectsPacker *mp)
+{
+  return g_bin_packer_check(G_BIN_PACKER(mp));
 }
 
-static guint
-gp_merge_free_rects_pass(GGuillotinePacker *gp)
+/* widen (or heighten) r as far as the edges of the atlas and the
+   packed rects, with their padding, let it; none of those may
+   overlap r in the first place */
+static void
+mp_grow_free_rect(GMaxRectsPacker *mp,
+                  GRect           *r,
+                  gboolean         horizontal)
 {
-  guint i, k;
-  guint merged = 0;
+  GBinPackerPrivate *priv = BP_GET_PRIV(mp);
+  guint lo = 0, hi = horizontal ? priv->width : priv->height;
+  guint i;
 
-  for (i = 0; i < gp->rects_free->len; i++)
+  for (i = 0; i < bp_rects_len(priv); i++)
     {
-      GRect *f = &g_array_index(gp->rects_free, GRect, i);
+      GRect u;
+      guint u0, u1, r0, r1;
+
+      bp_rects_get(priv, i, &u);
+      bp_rect_pad(priv, &u);
 
-      for (k = i + 1; k < gp->rects_free->len; k++)
+      if (horizontal)
         {
-          GRect *b = &g_array_index(gp->rects_free, GRect, k);
-          GRect u;
+          if (u.y >= r->y + r->height || u.y + u.height <= r->y)
+            continue;
 
-          if (!g_rect_merge(f, b, &u))
+          u0 = u.x;
+          u1 = u.x + u.width;
+          r0 = r->x;
+          r1 = r->x + r->width;
+        }
+      else
+        {
+          if (u.x >= r->x + r->width || u.x + u.width <= r->x)
             continue;
 
-          *f = u;
-          g_array_remove_index_fast(gp->rects_free, k);
-          merged += 1;
-          k--; /* we removed k, and replaced it, so check again */
+          u0 = u.y;
+          u1 = u.y + u.height;
+          r0 = r->y;
+          r1 = r->y + r->height;
         }
+
+      if (u1 <= r0)
+        lo = MAX(lo, u1);
+      else if (u0 >= r1)
+        hi = MIN(hi, u0);
     }
 
-  return merged;
+  if (horizontal)
+    {
+      r->x = lo;
+      r->width = hi - lo;
+    }
+  else
+    {
+      r->y = lo;
+      r->height = hi - lo;
+    }
 }
 
-gboolean
-g_guillotine_packer_pack(GGuillotinePacker *gp,
-                         const GRect       *r)
+/* add r to the free rects unless one of them contains it, and
+   drop the ones it contains */
+static void
+mp_add_free(GMaxRectsPacker *mp,
+            const GRect     *r)
 {
-  GArray *out;
-  GArray *in;
-  gboolean res;
+  GArray *rf = mp->rects_free;
+  guint i;
 
-  in = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
-  g_array_append_val(in, r);
+  for (i = 0; i < rf->len; i++)
+    {
+      const GRect *f = &g_array_index(rf, GRect, i);
+
+      if (mp_rect_contains(f, r))
+        return;
 
-  out = g_guillotine_packer_insert(gp, in);
-  res = out->len == in->len;
-  g_array_free(out, TRUE);
+      if (mp_rect_contains(r, f))
+        g_array_remove_index_fast(rf, i--);
+    }
 
-  return res;
+  g_array_append_vals(rf, r, 1);
 }
 
-GArray *
-g_guillotine_packer_insert(GGuillotinePacker *gp,
-			   GArray            *bins)
+/* the rect is grown into a maximal free rect across and one
+   along, which stand in for it and for all the free rects inside
+   them. Other maximal rects through its space are not looked for,
+   so the free rects then cover the free space, but not with
+   every maximal rect there is */
+static void
+g_max_rects_packer_release(GBinPacker  *packer,
+                           const GRect *rect)
 {
-  GBinPackerPrivate *base = BP_GET_PRIV(gp);
-  GArray *out;
-  guint i, k;
+  GMaxRectsPacker *mp = G_MAX_RECTS_PACKER(packer);
+  GRect across = *rect, along = *rect;
 
-  out = g_array_sized_new(FALSE, FALSE, sizeof(GRect), bins->len);
-
-  while (bins->len > 0)
-    {
-      GRect inserted;
-      int   score = G_MAXINT;     /* smaller is better */
-      gsize pos;                  /* position of the free rect to use (i) */
-      gsize idx;                  /* index of the best fitting rect (k) */
-
-      GRect *f;
-      GRect *b;
-
-      GRect lt, rl;
-
-      for (i = 0; i < gp->rects_free->len; i++)
-	{
-	  f = &g_array_index(gp->rects_free, GRect, i);
-
-	  for (k = 0; k < bins->len; k++)
-	    {
-	      b = &g_array_index(bins, GRect, k);
-
-	      if (g_rect_size_equal(f, b))
-		{
-		  pos = i;
-		  idx = k;
-		  score = G_MININT;
-
-                  /* it cant get better, drop out of both loops */
-                  i = gp->rects_free->len;
-                  break;
-		}
-	      else if (g_rect_can_fit(f, b))
-		{
-		  int my_score = g_rect_fit(f, b, gp->fit_method);
-		  if (my_score < score)
-		    {
-		      pos = i;
-		      idx = k;
-		      score = my_score;
-		    }
-		}
-	    }
-        }
+  mp_grow_free_rect(mp, &across, TRUE);
+  mp_grow_free_rect(mp, &across, FALSE);
+  mp_add_free(mp, &across);
 
-      if (score == G_MAXINT)
-        {
-          return out;
-        }
+  mp_grow_free_rect(mp, &along, FALSE);
+  mp_grow_free_rect(mp, &along, TRUE);
+
+  if (!bp_rect_same(&across, &along))
+    mp_add_free(mp, &along);
 
-      f = &g_array_index(gp->rects_free, GRect, pos);
-      b = &g_array_index(bins, GRect, idx);
+  mp_free_sizes_sync(mp, 0);
+}
 
-      inserted.x = f->x;
-      inserted.y = f->y;
-      inserted.height = b->height;
-      inserted.width  = b->width;
-      inserted.id = b->id;
+static void
+g_max_rects_packer_grow(GBinPacker *packer,
+                        guint       old_width,
+                        guint       old_height)
+{
+  GMaxRectsPacker *mp = G_MAX_RECTS_PACKER(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(mp);
+  GArray *rf = mp->rects_free;
+  GRect r = {0, };
+  guint i, k;
 
-      g_rect_guillotine(f, b, &lt, &rl, gp->split_method);
-      g_array_remove_index_fast(gp->rects_free, pos);
+  /* free rects on the old border now reach the new one */
+  for (i = 0; i < rf->len; i++)
+    {
+      GRect *f = &g_array_index(rf, GRect, i);
 
-      if (g_rect_area_nonzero(&lt))
-        g_array_append_val(gp->rects_free, lt);
+      if (f->x + f->width == old_width)
+        f->width = priv->width - f->x;
 
-      if (g_rect_area_nonzero(&rl))
-        g_array_append_val(gp->rects_free, rl);
+      if (f->y + f->height == old_height)
+        f->height = priv->height - f->y;
+    }
 
-      if (gp->merge_free)
-        {
-          guint merged = gp_merge_free_rects_pass(gp);
-          g_debug("GP: merged %u free rects", merged);
-        }
+  r.x = old_width;
+  r.width = priv->width - old_width;
+  r.height = priv->height;
 
-      g_array_append_val(base->rects, inserted);
-      g_array_append_val(out, inserted);
-      g_array_remove_index(bins, idx);
+  if (g_rect_area_nonzero(&r))
+    g_array_append_val(rf, r);
 
-    }
+  r.x = 0;
+  r.y = old_height;
+  r.width = priv->width;
+  r.height = priv->height - old_height;
 
-  return out;
+  if (g_rect_area_nonzero(&r))
+    g_array_append_val(rf, r);
+
+  /* rare enough to just prune all of them */
+  for (i = 0; i < rf->len; i++)
+    for (k = 0; k < rf->len; k++)
+      {
+        if (i == k ||
+            !mp_rect_contains(&g_array_index(rf, GRect, k),
+                              &g_array_index(rf, GRect, i)))
+          continue;
+
+        g_array_remove_index_fast(rf, i--);
+        break;
+      }
+
+  mp_free_sizes_sync(mp, 0);
 }
 
-GArray *
-g_guillotine_packer_check(GGuillotinePacker *gp)
+static void
+g_max_rects_packer_save(GBinPacker *packer,
+                        GByteArray *out)
 {
-  GBinPackerPrivate *base = BP_GET_PRIV(gp);
-  const guint n_free = gp->rects_free->len;
-  const guint n_used = base->rects->len;
-  const guint n = n_free + n_used;
-  GArray *bad = NULL;
-  GArray *all;
-  guint  i;
+  bp_write_rects(out, G_MAX_RECTS_PACKER(packer)->rects_free);
+}
 
-  all = g_array_sized_new(FALSE, FALSE, sizeof(GRect), n);
+static gboolean
+g_max_rects_packer_load(GBinPacker    *packer,
+                        const guint8 **data,
+                        gsize         *size)
+{
+  GMaxRectsPacker *mp = G_MAX_RECTS_PACKER(packer);
 
-  g_array_append_vals(all, gp->rects_free->data, n_free);
-  g_array_append_vals(all, base->rects->data, n_used);
+  if (!bp_read_rects(data, size, mp->rects_free) ||
+      !bp_rects_inside(BP_GET_PRIV(mp), mp->rects_free))
+    return FALSE;
 
-  for (i = 0; i < n; i++)
-    {
-      const GRect *a = &g_array_index(all, GRect, i);
-      guint k;
+  mp_free_sizes_sync(mp, 0);
 
-      for (k = i + 1; k < n; k++)
-        {
-          const GRect *b = &g_array_index(all, GRect, k);
-          GRect o = {0, };
+  return TRUE;
+}
 
-          if (!g_rect_intersect(a, b, &o))
-            continue;
+/* the free rects are maximal, so they do overlap */
+static gboolean
+g_max_rects_packer_free_space(GBinPacker *packer,
+                              GArray     *rects)
+{
+  GArray *rf = G_MAX_RECTS_PACKER(packer)->rects_free;
 
-          if (bad == NULL)
-            bad = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+  g_array_append_vals(rects, rf->data, rf->len);
+  return FALSE;
+}
 
-          g_array_append_val(bad, o);
-          /* we keep going to find all errors */
-        }
-    }
+static void
+g_max_rects_packer_stats(GBinPacker      *packer,
+                         GBinPackerStats *stats)
+{
+  GMaxRectsPacker *mp = G_MAX_RECTS_PACKER(packer);
 
-  return bad;
+  stats->n_free_rects = mp->rects_free->len;
+  stats->largest_free = mp->largest;
 }
 
 /* ************************************************************************** */
 
-struct _GSkylinePacker {
-  GBinPacker         parent;
+typedef struct Shelf {
+  guint y;
+  guint height;
+  guint cursor;  /* x of the first free column */
+  guint n_rects; /* packed on it */
+} Shelf;
 
-  GArray            *skyline;
+struct _GShelfPacker {
+  GBinPacker parent;
 
-  gboolean           use_wm;
-  GGuillotinePacker *wastemap;
+  GArray    *shelves;
+
+  /* height class to the index of the shelf that is currently
+     being filled for it, or G_MAXUINT if there is none */
+  GArray    *open;
+
+  guint      granularity;
+  guint      top;     /* y of the next shelf */
+  guint64    filled;  /* left of the cursors of all the shelves */
 };
 
 enum {
-  PROP_SP_0,
-  PROP_SP_SKYLINE,
-  PROP_SP_USE_WASTEMAP,
-  PROP_SP_LAST
+  PROP_SHP_0,
+  PROP_SHP_SHELVES,
+  PROP_SHP_GRANULARITY,
+  PROP_SHP_LAST
 };
-static GParamSpec *sp_props[PROP_SP_LAST] = { NULL, };
+static GParamSpec *shp_props[PROP_SHP_LAST] = { NULL, };
 
-G_DEFINE_TYPE(GSkylinePacker, g_skyline_packer, G_TYPE_BIN_PACKER);
+G_DEFINE_TYPE(GShelfPacker, g_shelf_packer, G_TYPE_BIN_PACKER);
 
 static void
-g_skyline_packer_finalize(GObject *obj)
+g_shelf_packer_finalize(GObject *obj)
 {
-  GSkylinePacker *sp = G_SKYLINE_PACKER(obj);
+  GShelfPacker *shp = G_SHELF_PACKER(obj);
 
-  g_array_free(sp->skyline, TRUE);
-  g_clear_pointer(&sp->wastemap, g_object_unref);
+  g_array_free(shp->shelves, TRUE);
+  g_array_free(shp->open, TRUE);
 
-  G_OBJECT_CLASS(g_skyline_packer_parent_class)->finalize(obj);
+  G_OBJECT_CLASS(g_shelf_packer_parent_class)->finalize(obj);
 }
 
 static void
-g_skyline_packer_get_property(GObject    *object,
-                                 guint       prop_id,
-                                 GValue     *value,
-                                 GParamSpec *pspec)
+g_shelf_packer_get_property(GObject    *object,
+                            guint       prop_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
 {
-  GSkylinePacker *sp = G_SKYLINE_PACKER(object);
+  GShelfPacker *shp = G_SHELF_PACKER(object);
 
   switch (prop_id) {
-  case PROP_SP_SKYLINE:
-    g_value_set_boxed(value, sp->skyline);
+  case PROP_SHP_SHELVES:
+    g_value_set_boxed(value, shp->shelves);
+    break;
+
+  case PROP_SHP_GRANULARITY:
+    g_value_set_uint(value, shp->granularity);
+    break;
+  }
+}
+
+static void
+g_shelf_packer_set_property(GObject      *object,
+                            guint         prop_id,
+                            const GValue *value,
+                            GParamSpec   *pspec)
+{
+  GShelfPacker *shp = G_SHELF_PACKER(object);
+
+  switch (prop_id) {
+  case PROP_SHP_GRANULARITY:
+    shp->granularity = g_value_get_uint(value);
     break;
+  }
+}
+
+static void
+g_shelf_packer_constructed(GObject *obj)
+{
+  GShelfPacker *shp = G_SHELF_PACKER(obj);
+  GBinPackerPrivate *priv = BP_GET_PRIV(shp);
+  guint i;
+
+  G_OBJECT_CLASS(g_shelf_packer_parent_class)->constructed(obj);
+
+  g_array_set_size(shp->open, priv->height / shp->granularity + 1);
+
+  for (i = 0; i < shp->open->len; i++)
+    g_array_index(shp->open, guint, i) = G_MAXUINT;
+}
+
+static void
+g_shelf_packer_init(GShelfPacker *shp)
+{
+  shp->shelves = g_array_sized_new(FALSE, FALSE, sizeof(Shelf), 16);
+  shp->open = g_array_sized_new(FALSE, FALSE, sizeof(guint), 1);
+  shp->granularity = 4;
+}
+
+static GArray *
+g_shelf_packer_insert_bins(GBinPacker *packer,
+                           GArray     *bins)
+{
+  return g_shelf_packer_insert(G_SHELF_PACKER(packer), bins);
+}
+
+static gboolean shelf_pack(GShelfPacker *shp,
+                           GRect        *r);
+
+static gboolean
+g_shelf_packer_pack_rect(GBinPacker *packer,
+                         GRect      *r)
+{
+  return shelf_pack(G_SHELF_PACKER(packer), r);
+}
+
+static guint shelf_place_pending(GShelfPacker *shp,
+                                 GRect        *rects,
+                                 guint         n_rects,
+                                 guint        *order);
+
+static guint
+g_shelf_packer_place_rects(GBinPacker *packer,
+                           GRect      *rects,
+                           guint       n_rects,
+                           guint      *order)
+{
+  return shelf_place_pending(G_SHELF_PACKER(packer), rects, n_rects, order);
+}
+
+static void g_shelf_packer_release(GBinPacker  *packer,
+                                   const GRect *rect);
+static void g_shelf_packer_grow(GBinPacker *packer,
+                                guint       old_width,
+                                guint       old_height);
+static void g_shelf_packer_save(GBinPacker *packer,
+                                GByteArray *out);
+static gboolean g_shelf_packer_load(GBinPacker    *packer,
+                                    const guint8 **data,
+                                    gsize         *size);
+static gboolean g_shelf_packer_free_space(GBinPacker *packer,
+                                          GArray     *rects);
+static void g_shelf_packer_stats(GBinPacker      *packer,
+                                 GBinPackerStats *stats);
+
+static void
+g_shelf_packer_class_init(GShelfPackerClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+
+  gobject_class->finalize     = g_shelf_packer_finalize;
+  gobject_class->get_property = g_shelf_packer_get_property;
+  gobject_class->set_property = g_shelf_packer_set_property;
+  gobject_class->constructed  = g_shelf_packer_constructed;
+
+  G_BIN_PACKER_CLASS(klass)->release = g_shelf_packer_release;
+  G_BIN_PACKER_CLASS(klass)->grow    = g_shelf_packer_grow;
+  G_BIN_PACKER_CLASS(klass)->insert  = g_shelf_packer_insert_bins;
+  G_BIN_PACKER_CLASS(klass)->pack    = g_shelf_packer_pack_rect;
+  G_BIN_PACKER_CLASS(klass)->place   = g_shelf_packer_place_rects;
+  G_BIN_PACKER_CLASS(klass)->save    = g_shelf_packer_save;
+  G_BIN_PACKER_CLASS(klass)->load    = g_shelf_packer_load;
+  G_BIN_PACKER_CLASS(klass)->free_space = g_shelf_packer_free_space;
+  G_BIN_PACKER_CLASS(klass)->stats   = g_shelf_packer_stats;
+
+  shp_props[PROP_SHP_SHELVES] =
+    g_param_spec_boxed("shelves",
+                       NULL, NULL,
+                       G_TYPE_ARRAY,
+                       G_PARAM_READABLE |
+                       G_PARAM_STATIC_NICK);
+
+  /* shelf heights are multiples of this, so that bins of
+     about the same height end up on the same shelves */
+  shp_props[PROP_SHP_GRANULARITY] =
+    g_param_spec_uint("granularity",
+                      NULL, NULL,
+                      1, G_MAXUINT, 4,
+                      G_PARAM_READWRITE |
+                      G_PARAM_CONSTRUCT_ONLY |
+                      G_PARAM_STATIC_NICK);
+
+  g_object_class_install_properties(gobject_class,
+                                    PROP_SHP_LAST,
+                                    shp_props);
+}
+
+static gboolean
+shelf_place(GShelfPacker *shp,
+            Shelf        *s,
+            GRect        *r)
+{
+  BP_COUNT(BP_GET_PRIV(shp), scored, 1);
+
+  if (s->cursor + r->width > BP_GET_PRIV(shp)->width)
+    return FALSE;
+
+  r->x = s->cursor;
+  r->y = s->y;
+  s->cursor += r->width;
+  s->n_rects++;
+  shp->filled += (guint64) r->width * s->height;
+
+  return TRUE;
+}
+
+/* the stages of placing r: the open shelf for its height class,
+   a fresh shelf, and first fit over all the shelves once the atlas
+   is full */
+typedef enum {
+  SHELF_OPEN,
+  SHELF_FRESH,
+  SHELF_ANY
+} ShelfStage;
+
+static gboolean
+shelf_packer_place_stage(GShelfPacker *shp,
+                         GRect        *r,
+                         ShelfStage    stage)
+{
+  GBinPackerPrivate *base = BP_GET_PRIV(shp);
+  const guint g = shp->granularity;
+  const guint a = base->alignment;
+  guint height = (r->height + g - 1) / g * g;
+  guint *open;
+  Shelf s;
+  guint i;
+
+  if (r->width > base->width || r->height > base->height)
+    return FALSE;
+
+  /* shelves start at multiples of the alignment as well */
+  height = (height + a - 1) / a * a;
+  height = MIN(height, base->height);
+  open = &g_array_index(shp->open, guint, height / g);
+
+  switch (stage)
+    {
+    case SHELF_OPEN:
+      return *open != G_MAXUINT &&
+        shelf_place(shp, &g_array_index(shp->shelves, Shelf, *open), r);
+
+    case SHELF_FRESH:
+      if (shp->top + height > base->height)
+        return FALSE;
+
+      s.y = shp->top;
+      s.height = height;
+      s.cursor = 0;
+      s.n_rects = 0;
+
+      shelf_place(shp, &s, r);
+
+      *open = shp->shelves->len;
+      shp->top += height;
+      g_array_append_val(shp->shelves, s);
+
+      return TRUE;
+
+    case SHELF_ANY:
+    default:
+      for (i = 0; i < shp->shelves->len; i++)
+        {
+          Shelf *t = &g_array_index(shp->shelves, Shelf, i);
+
+          if (t->height >= r->height && shelf_place(shp, t, r))
+            return TRUE;
+        }
+
+      return FALSE;
+    }
+}
+
+/* with rotation allowed every stage tries r as given first and
+   then turned, before moving on to the next one */
+static gboolean
+shelf_packer_place(GShelfPacker *shp,
+                   GRect        *r)
+{
+  const gboolean turn = BP_GET_PRIV(shp)->allow_rotation &&
+                        r->width != r->height;
+  ShelfStage stage;
+
+  for (stage = SHELF_OPEN; stage <= SHELF_ANY; stage++)
+    {
+      if (r->rotated)
+        bp_rect_turn(r);
+
+      if (shelf_packer_place_stage(shp, r, stage))
+        return TRUE;
+
+      if (!turn)
+        continue;
+
+      bp_rect_turn(r);
+
+      if (shelf_packer_place_stage(shp, r, stage))
+        return TRUE;
+    }
+
+  if (r->rotated)
+    bp_rect_turn(r);
+
+  return FALSE;
+}
+
+/* place a single rect, r gets its position on success */
+static gboolean
+shelf_pack(GShelfPacker *shp,
+           GRect        *r)
+{
+  GBinPackerPrivate *base = BP_GET_PRIV(shp);
+
+  r->rotated = FALSE;
+
+  if (!shelf_packer_place(shp, r))
+    {
+      r->x = r->y = G_RECT_UNPLACED;
+      return FALSE;
+    }
+
+  bp_rects_append(base, r);
+  return TRUE;
+}
+
+/* the same with the padding and alignment of the packer */
+gboolean
+g_shelf_packer_pack(GShelfPacker *shp,
+                    GRect        *r)
+{
+  return bp_pack(G_BIN_PACKER(shp), r);
+}
+
+/* in order, the ones that do not fit stay pending */
+static guint
+shelf_place_pending(GShelfPacker *shp,
+                    GRect        *rects,
+                    guint         n_rects,
+                    guint        *order)
+{
+  guint i, n_placed = 0;
+
+  for (i = 0; i < n_rects; i++)
+    if (rects[i].x == G_RECT_UNPLACED && shelf_pack(shp, &rects[i]))
+      order[n_placed++] = i;
+
+  return n_placed;
+}
+
+GArray *
+g_shelf_packer_insert(GShelfPacker *shp,
+                      GArray       *bins)
+{
+  return bp_insert(G_BIN_PACKER(shp), bins);
+}
+
+/* the shelf r was packed on, G_MAXUINT if there is none */
+static guint
+shelf_find(GShelfPacker *shp,
+           const GRect  *r)
+{
+  guint i;
+
+  for (i = 0; i < shp->shelves->len; i++)
+    {
+      const Shelf *s = &g_array_index(shp->shelves, Shelf, i);
 
-  case PROP_SP_USE_WASTEMAP:
-    g_value_set_boolean(value, sp->wastemap != NULL);
-    break;
-  }
-}
+      if (s->y == r->y && s->height >= r->height &&
+          r->x + r->width <= s->cursor)
+        return i;
+    }
 
+  return G_MAXUINT;
+}
 
+/* the last rect on a shelf gives its space back, the space of the
+   others stays a hole until the shelf is empty. Empty shelves on
+   top go away, their height goes back to the space above */
 static void
-g_skyline_packer_set_property(GObject      *object,
-                                 guint         prop_id,
-                                 const GValue *value,
-                                 GParamSpec   *pspec)
+g_shelf_packer_release(GBinPacker  *packer,
+                       const GRect *rect)
 {
-  GSkylinePacker *sp = G_SKYLINE_PACKER(object);
+  GShelfPacker *shp = G_SHELF_PACKER(packer);
+  const guint i = shelf_find(shp, rect);
+  Shelf *s;
 
-  switch (prop_id) {
-  case PROP_SP_USE_WASTEMAP:
-     sp->use_wm = g_value_get_boolean(value);
-    break;
-  }
+  if (i == G_MAXUINT)
+    return;
 
-}
+  s = &g_array_index(shp->shelves, Shelf, i);
 
+  if (--s->n_rects == 0)
+    {
+      shp->filled -= (guint64) s->cursor * s->height;
+      s->cursor = 0;
+    }
+  else if (s->cursor == rect->x + rect->width)
+    {
+      shp->filled -= (guint64) rect->width * s->height;
+      s->cursor = rect->x;
+    }
 
-static void
-g_skyline_packer_constructed(GObject *obj)
-{
-  GSkylinePacker *sp = G_SKYLINE_PACKER(obj);
-  GBinPackerPrivate *priv = BP_GET_PRIV(sp);
-  GRect *r;
+  while (shp->shelves->len > 0)
+    {
+      const guint last = shp->shelves->len - 1;
+      guint *open;
 
-  G_OBJECT_CLASS(g_skyline_packer_parent_class)->constructed(obj);
+      s = &g_array_index(shp->shelves, Shelf, last);
 
-  sp->skyline->len = 1;
+      if (s->n_rects > 0)
+        break;
 
-  r = &g_array_index(sp->skyline, GRect, 0);
-  r->x = r->y = 0;
+      open = &g_array_index(shp->open, guint, s->height / shp->granularity);
+      if (*open == last)
+        *open = G_MAXUINT;
 
-  r->width  = priv->width;
-  r->height = 0; //not actually needed
+      shp->top = s->y;
+      g_array_set_size(shp->shelves, last);
+    }
 }
 
+/* the shelves just get longer, only new height classes need
+   to be tracked */
 static void
-g_skyline_packer_init(GSkylinePacker *sp)
+g_shelf_packer_grow(GBinPacker *packer,
+                    guint       old_width,
+                    guint       old_height)
 {
-  sp->skyline = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+  GShelfPacker *shp = G_SHELF_PACKER(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(shp);
+  guint i = shp->open->len;
+
+  g_array_set_size(shp->open, priv->height / shp->granularity + 1);
+
+  for (; i < shp->open->len; i++)
+    g_array_index(shp->open, guint, i) = G_MAXUINT;
 }
 
 static void
-g_skyline_packer_class_init(GSkylinePackerClass *klass)
+g_shelf_packer_save(GBinPacker *packer,
+                    GByteArray *out)
 {
-  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GShelfPacker *shp = G_SHELF_PACKER(packer);
+  guint i;
 
-  gobject_class->finalize     = g_skyline_packer_finalize;
-  gobject_class->get_property = g_skyline_packer_get_property;
-  gobject_class->set_property = g_skyline_packer_set_property;
-  gobject_class->constructed  = g_skyline_packer_constructed;
+  bp_write_u32(out, shp->top);
+  bp_write_u32(out, shp->shelves->len);
 
-  sp_props[PROP_SP_SKYLINE] =
-    g_param_spec_boxed("skyline",
-                       NULL, NULL,
-                       G_TYPE_ARRAY,
-                       G_PARAM_READABLE |
-                       G_PARAM_STATIC_NICK);
+  for (i = 0; i < shp->shelves->len; i++)
+    {
+      const Shelf *s = &g_array_index(shp->shelves, Shelf, i);
 
-  sp_props[PROP_SP_USE_WASTEMAP] =
-    g_param_spec_boolean("use-wastemap",
-                         NULL, NULL, TRUE,
-                         G_PARAM_READWRITE |
-                         G_PARAM_CONSTRUCT_ONLY |
-                         G_PARAM_STATIC_NICK);
+      bp_write_u32(out, s->y);
+      bp_write_u32(out, s->height);
+      bp_write_u32(out, s->cursor);
+    }
 
-  g_object_class_install_properties(gobject_class,
-                                    PROP_SP_LAST,
-                                    sp_props);
-}
+  bp_write_u32(out, shp->open->len);
 
-typedef enum GSkylinePackerLevel {
-  GSP_LEVEL_BOTTOM_LEFT,
-  GSP_LEVEL_MIN_WASTE,
-} GSkylinePackerLevel;
+  for (i = 0; i < shp->open->len; i++)
+    bp_write_u32(out, g_array_index(shp->open, guint, i));
+}
 
 static gboolean
-skyline_fit_rect_at(GSkylinePacker *sp,
-                    const GRect     *r,
-                    guint           index,
-                    guint           *y_out)
+g_shelf_packer_load(GBinPacker    *packer,
+                    const guint8 **data,
+                    gsize         *size)
 {
-  GBinPackerPrivate *base = BP_GET_PRIV(sp);
-  GRect *n = &g_array_index(sp->skyline, GRect, index);
-  int space;
-  guint y;
+  GShelfPacker *shp = G_SHELF_PACKER(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(shp);
+  guint32 top, n, i;
 
-  if (n->x + r->width > base->width)
+  if (!bp_read_u32(data, size, &top) || top > priv->height ||
+      !bp_read_count(data, size, 3 * sizeof(guint32), &n))
     return FALSE;
 
-  space = r->width;
-  y = n->y;
+  shp->top = top;
+  shp->filled = 0;
+  g_array_set_size(shp->shelves, n);
 
-  while (space > 0)
+  for (i = 0; i < n; i++)
     {
-      y = MAX(y, n->y);
+      Shelf *s = &g_array_index(shp->shelves, Shelf, i);
+      guint32 v[3] = {0, };
 
-      if (y + r->height > base->height)
+      bp_read_u32(data, size, &v[0]);
+      bp_read_u32(data, size, &v[1]);
+      bp_read_u32(data, size, &v[2]);
+
+      s->y = v[0];
+      s->height = v[1];
+      s->cursor = v[2];
+      s->n_rects = 0;
+
+      /* the shelves are all below the top one */
+      if (s->y > top || s->height > top - s->y || s->cursor > priv->width)
+        return FALSE;
+
+      shp->filled += (guint64) s->cursor * s->height;
+    }
+
+  /* every packed rect sits on one of them */
+  for (i = 0; i < bp_rects_len(priv); i++)
+    {
+      GRect r;
+      guint k;
+
+      bp_rects_get(priv, i, &r);
+      bp_rect_pad(priv, &r);
+
+      k = shelf_find(shp, &r);
+      if (k == G_MAXUINT)
         return FALSE;
 
-      space -= n->width;
-      index++;
+      g_array_index(shp->shelves, Shelf, k).n_rects++;
+    }
+
+  /* one per height class, as made for the size we have */
+  if (!bp_read_u32(data, size, &n) || n != shp->open->len)
+    return FALSE;
+
+  for (i = 0; i < n; i++)
+    {
+      guint32 open;
+
+      if (!bp_read_u32(data, size, &open) ||
+          (open != G_MAXUINT && open >= shp->shelves->len))
+        return FALSE;
 
-      g_assert(index < sp->skyline->len || space <= 0);
-      n = &g_array_index(sp->skyline, GRect, index);
+      g_array_index(shp->open, guint, i) = open;
     }
 
-  *y_out = y;
   return TRUE;
 }
 
-#if 0
-static int
-skyline_compute_waste(GSkylinePacker *sp,
-                      guint   index,
-                      GRect  *r)
+/* the rest of every shelf and everything above the top one */
+static gboolean
+g_shelf_packer_free_space(GBinPacker *packer,
+                          GArray     *rects)
 {
-  int waste = 0;
-  GRect *n = &g_array_index(sp->skyline, GRect, index);
-  const int left = n->x;
-  const int right = left + r->width;
+  GShelfPacker *shp = G_SHELF_PACKER(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(shp);
+  GRect r = {0, };
+  guint i;
 
-  while (index < sp->skyline->len && n->x < right)
+  for (i = 0; i < shp->shelves->len; i++)
     {
-      const int ls = n->x;
-      const int rs = MIN(right, ls + n->width);
-
-      if (ls >= right || n->x + n->width <= left)
-        break;
+      const Shelf *s = &g_array_index(shp->shelves, Shelf, i);
 
+      if (s->cursor >= priv->width)
+        continue;
 
-      waste += (rs - ls) * (r->y - n->y);
+      r.x = s->cursor;
+      r.y = s->y;
+      r.width = priv->width - s->cursor;
+      r.height = s->height;
+      g_array_append_val(rects, r);
+    }
 
-      index++;
-      n = &g_array_index(sp->skyline, GRect, index);
+  if (shp->top < priv->height)
+    {
+      r.x = 0;
+      r.y = shp->top;
+      r.width = priv->width;
+      r.height = priv->height - shp->top;
+      g_array_append_val(rects, r);
     }
 
-  return waste;
+  return TRUE;
 }
 
-
-static gboolean
-skyline_fit_rect_at_waste(GSkylinePacker *sp,
-                          guint   index,
-                          GRect  *r,
-                          int    *waste)
+/* what is left of the cursors and not packed is lost to rects
+   lower than their shelf */
+static void
+g_shelf_packer_stats(GBinPacker      *packer,
+                     GBinPackerStats *stats)
 {
-  if (! skyline_fit_rectangle(sp, index, r))
-    return FALSE;
+  GShelfPacker *shp = G_SHELF_PACKER(packer);
+  GBinPackerPrivate *priv = BP_GET_PRIV(shp);
 
-  *waste = skyline_compute_waste(sp, index, r);
-  return TRUE;
+  stats->n_segments = shp->shelves->len;
+  stats->waste_area = shp->filled - MIN(shp->filled, stats->used_area);
+
+  if (shp->top < priv->height)
+    {
+      stats->largest_free.y = shp->top;
+      stats->largest_free.width = priv->width;
+      stats->largest_free.height = priv->height - shp->top;
+    }
 }
 
-#endif
+/* ************************************************************************** */
 
-typedef struct Score {
+struct _GBinPackerPool {
+  GObject    parent;
 
-  guint first;
-  guint second;
+  GType      packer_type;
+  guint      width;
+  guint      height;
+  guint      max_pages;  /* 0 means no limit */
+  gboolean   allow_rotation;
+  guint      padding;
+  guint      alignment;
 
-} Score;
+  GPtrArray *pages;
+};
 
-static gboolean
-score_check_and_update(Score *score,
-                       guint  first,
-                       guint  second)
+enum {
+  PROP_POOL_0,
+  PROP_POOL_PACKER_TYPE,
+  PROP_POOL_WIDTH,
+  PROP_POOL_HEIGHT,
+  PROP_POOL_MAX_PAGES,
+  PROP_POOL_ALLOW_ROTATION,
+  PROP_POOL_PADDING,
+  PROP_POOL_ALIGNMENT,
+  PROP_POOL_LAST
+};
+static GParamSpec *pool_props[PROP_POOL_LAST] = { NULL, };
+
+G_DEFINE_TYPE(GBinPackerPool, g_bin_packer_pool, G_TYPE_OBJECT);
+
+static void
+g_bin_packer_pool_finalize(GObject *obj)
 {
-  if (!(first < score->first ||
-        (first == score->first && second < score->second)))
-    return FALSE;
+  GBinPackerPool *pool = G_BIN_PACKER_POOL(obj);
 
-  score->first = first;
-  score->second = second;
+  g_ptr_array_unref(pool->pages);
 
-  return TRUE;
+  G_OBJECT_CLASS(g_bin_packer_pool_parent_class)->finalize(obj);
 }
 
-static gboolean
-position_node_bl(GSkylinePacker *sp,
-                 GRect          *r,
-                 guint          *index,
-                 Score          *score)
+static void
+g_bin_packer_pool_get_property(GObject    *object,
+                               guint       prop_id,
+                               GValue     *value,
+                               GParamSpec *pspec)
 {
-  guint i;
-  gboolean have_fit = FALSE;
-
-  score->first = G_MAXUINT;
-  score->second = G_MAXUINT;
+  GBinPackerPool *pool = G_BIN_PACKER_POOL(object);
 
-  for (i = 0; i < sp->skyline->len; i++)
-    {
-      GRect *n = &g_array_index(sp->skyline, GRect, i);
-      guint top;
-      guint y;
+  switch (prop_id) {
+  case PROP_POOL_PACKER_TYPE:
+    g_value_set_gtype(value, pool->packer_type);
+    break;
 
-      if (! skyline_fit_rect_at(sp, r, i, &y))
-        continue;
+  case PROP_POOL_WIDTH:
+    g_value_set_uint(value, pool->width);
+    break;
 
-      top = y + r->height;
+  case PROP_POOL_HEIGHT:
+    g_value_set_uint(value, pool->height);
+    break;
 
-      if (!score_check_and_update(score, top, n->width))
-        continue;
+  case PROP_POOL_MAX_PAGES:
+    g_value_set_uint(value, pool->max_pages);
+    break;
 
-      r->x = n->x;
-      r->y = y;
+  case PROP_POOL_ALLOW_ROTATION:
+    g_value_set_boolean(value, pool->allow_rotation);
+    break;
 
-      *index = i;
-      have_fit = TRUE;
-    }
+  case PROP_POOL_PADDING:
+    g_value_set_uint(value, pool->padding);
+    break;
 
-  return have_fit;
+  case PROP_POOL_ALIGNMENT:
+    g_value_set_uint(value, pool->alignment);
+    break;
+  }
 }
 
 static void
-skyline_add_level(GSkylinePacker *sp,
-                  const GRect    *r,
-                  guint           pos)
+g_bin_packer_pool_set_property(GObject      *object,
+                               guint         prop_id,
+                               const GValue *value,
+                               GParamSpec   *pspec)
 {
-  GBinPackerPrivate *base = BP_GET_PRIV(sp);
-  GRect a;
-  guint i;
+  GBinPackerPool *pool = G_BIN_PACKER_POOL(object);
 
-  a.x = r->x;
-  a.y = r->y + r->height;
-  a.width = r->width;
+  switch (prop_id) {
+  case PROP_POOL_PACKER_TYPE:
+    pool->packer_type = g_value_get_gtype(value);
+    break;
 
-  g_array_insert_val(sp->skyline, pos, a);
+  case PROP_POOL_WIDTH:
+    pool->width = g_value_get_uint(value);
+    break;
 
-  g_assert(a.x + a.width <= base->width);
-  g_assert(a.y <= base->height);
+  case PROP_POOL_HEIGHT:
+    pool->height = g_value_get_uint(value);
+    break;
 
-  for (i = pos + 1; i < sp->skyline->len; i++)
-    {
-      GRect *n = &g_array_index(sp->skyline, GRect, i);
-      GRect *b = &g_array_index(sp->skyline, GRect, i - 1);
-      int width = n->width;
-      int shrink;
+  case PROP_POOL_MAX_PAGES:
+    pool->max_pages = g_value_get_uint(value);
+    break;
 
-      g_assert(b->x <= n->x);
+  case PROP_POOL_ALLOW_ROTATION:
+    pool->allow_rotation = g_value_get_boolean(value);
+    break;
 
-      if (!(n->x < b->x + b->width))
-        break;
+  case PROP_POOL_PADDING:
+    pool->padding = g_value_get_uint(value);
+    break;
 
-      shrink = ((int) b->x + b->width) - n->x;
+  case PROP_POOL_ALIGNMENT:
+    pool->alignment = g_value_get_uint(value);
+    break;
+  }
+}
 
-      n->x += shrink;
-      width -= shrink;
+static void
+g_bin_packer_pool_init(GBinPackerPool *pool)
+{
+  pool->packer_type = G_TYPE_GUILLOTINE_PACKER;
+  pool->alignment = 1;
+  pool->pages = g_ptr_array_new_with_free_func(g_object_unref);
+}
 
-      if (width > 0)
-        {
-          n->width = width;
-          break;
-        }
+static void
+g_bin_packer_pool_class_init(GBinPackerPoolClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
 
-      g_array_remove_index(sp->skyline, i);
-      i--;
-    }
+  gobject_class->finalize     = g_bin_packer_pool_finalize;
+  gobject_class->get_property = g_bin_packer_pool_get_property;
+  gobject_class->set_property = g_bin_packer_pool_set_property;
 
-  /*  */
-  if (sp->skyline->len == 0)
-    return; /* avoid overflow in case of len == 0 below */
+  pool_props[PROP_POOL_PACKER_TYPE] =
+    g_param_spec_gtype("packer-type",
+                       NULL, NULL,
+                       G_TYPE_BIN_PACKER,
+                       G_PARAM_READWRITE |
+                       G_PARAM_CONSTRUCT_ONLY |
+                       G_PARAM_STATIC_NICK);
 
-  for (i = 0; i < sp->skyline->len - 1; i++)
-    {
-      GRect *n = &g_array_index(sp->skyline, GRect, i);
-      GRect *b = &g_array_index(sp->skyline, GRect, i + 1);
+  pool_props[PROP_POOL_WIDTH] =
+    g_param_spec_uint("width",
+                      NULL, NULL,
+                      0, G_MAXUINT, 0,
+                      G_PARAM_READWRITE |
+                      G_PARAM_CONSTRUCT_ONLY |
+                      G_PARAM_STATIC_NICK);
 
-      if (n->y != b->y)
-        continue;
+  pool_props[PROP_POOL_HEIGHT] =
+    g_param_spec_uint("height",
+                      NULL, NULL,
+                      0, G_MAXUINT, 0,
+                      G_PARAM_READWRITE |
+                      G_PARAM_CONSTRUCT_ONLY |
+                      G_PARAM_STATIC_NICK);
 
-      n->width += b->width;
-      g_array_remove_index(sp->skyline, i + 1);
-      i--;
-    }
+  pool_props[PROP_POOL_MAX_PAGES] =
+    g_param_spec_uint("max-pages",
+                      NULL, NULL,
+                      0, G_MAXUINT, 0,
+                      G_PARAM_READWRITE |
+                      G_PARAM_CONSTRUCT_ONLY |
+                      G_PARAM_STATIC_NICK);
+
+  /* these are handed on to every page */
+  pool_props[PROP_POOL_ALLOW_ROTATION] =
+    g_param_spec_boolean("allow-rotation",
+                         NULL, NULL,
+                         FALSE,
+                         G_PARAM_READWRITE |
+                         G_PARAM_CONSTRUCT_ONLY |
+                         G_PARAM_STATIC_NICK);
+
+  pool_props[PROP_POOL_PADDING] =
+    g_param_spec_uint("padding",
+                      NULL, NULL,
+                      0, G_MAXUINT16, 0,
+                      G_PARAM_READWRITE |
+                      G_PARAM_CONSTRUCT_ONLY |
+                      G_PARAM_STATIC_NICK);
+
+  pool_props[PROP_POOL_ALIGNMENT] =
+    g_param_spec_uint("alignment",
+                      NULL, NULL,
+                      1, G_MAXUINT16, 1,
+                      G_PARAM_READWRITE |
+                      G_PARAM_CONSTRUCT_ONLY |
+                      G_PARAM_STATIC_NICK);
+
+  g_object_class_install_properties(gobject_class,
+                                    PROP_POOL_LAST,
+                                    pool_props);
 }
 
+/* the existing pages are filled up in order before a new one is
+   started, so that the bins end up on as few pages as possible.
+   Bins that do not even fit on an empty page stay in bins */
 GArray *
-g_skyline_packer_insert(GSkylinePacker *sp,
-                        GArray         *bins)
+g_bin_packer_pool_insert(GBinPackerPool *pool,
+                         GArray         *bins)
 {
-  GBinPackerPrivate *base = BP_GET_PRIV(sp);
-  GArray *out = g_array_sized_new(FALSE, FALSE, sizeof(GRect), bins->len);
+  GArray *out;
+  guint page;
 
-  while (bins->len > 0)
+  out = g_array_sized_new(FALSE, FALSE, sizeof(GPageRect), bins->len);
+
+  for (page = 0; bins->len > 0; page++)
     {
-      gboolean have_fit = FALSE;
-      Score score = {G_MAXUINT, G_MAXUINT};
-      GRect best;
-      guint best_skyline;
-      guint best_bin;
+      gboolean fresh = page == pool->pages->len;
+      GBinPacker *packer;
+      GArray *placed;
       guint i;
 
-      for (i = 0; i < bins->len; i++)
+      if (fresh && pool->max_pages > 0 && page == pool->max_pages)
+        break;
+
+      if (fresh)
+        g_ptr_array_add(pool->pages,
+                        g_object_new(pool->packer_type,
+                                     "width", pool->width,
+                                     "height", pool->height,
+                                     "allow-rotation", pool->allow_rotation,
+                                     "padding", pool->padding,
+                                     "alignment", pool->alignment,
+                                     NULL));
+
+      packer = g_ptr_array_index(pool->pages, page);
+      placed = g_bin_packer_insert(packer, bins);
+
+      for (i = 0; i < placed->len; i++)
         {
-          GRect t = g_array_index(bins, GRect, i);
-          Score s;
-          guint idx;
+          GPageRect pr;
 
-          if (!position_node_bl(sp, &t, &idx, &s) ||
-              !score_check_and_update(&score, s.first, s.second))
-              continue;
+          pr.page = page;
+          pr.rect = g_array_index(placed, GRect, i);
 
-          best = t;
-          best_skyline = idx;
-          best_bin = i;
-          have_fit = TRUE;
+          g_array_append_val(out, pr);
         }
 
-      if (!have_fit)
-        break;
-
-      skyline_add_level(sp, &best, best_skyline);
+      if (fresh && placed->len == 0)
+        {
+          g_ptr_array_remove_index(pool->pages, page);
+          g_array_free(placed, TRUE);
+          break;
+        }
 
-      g_array_append_val(base->rects, best);
-      g_array_append_val(out, best);
-      g_array_remove_index_fast(bins, best_bin);
+      g_array_free(placed, TRUE);
     }
 
   return out;
 }
+
+gboolean
+g_bin_packer_pool_remove(GBinPackerPool *pool,
+                         gpointer        id)
+{
+  guint i;
+
+  for (i = 0; i < pool->pages->len; i++)
+    if (g_bin_packer_remove(g_ptr_array_index(pool->pages, i), id))
+      return TRUE;
+
+  return FALSE;
+}
+
+guint
+g_bin_packer_pool_get_n_pages(GBinPackerPool *pool)
+{
+  return pool->pages->len;
+}
+
+GBinPacker *
+g_bin_packer_pool_get_page(GBinPackerPool *pool,
+                           guint           page)
+{
+  g_return_val_if_fail(page < pool->pages->len, NULL);
+
+  return g_ptr_array_index(pool->pages, page);
+}
@@ -16,9 +16,18 @@ typedef struct _GRect {
   guint height;
   guint width;
 
+  /* placed turned clockwise by 90°, width and height are the
+     placed ones; only with "allow-rotation". This field grew
+     GRect from 24 to 32 bytes on 64 bit platforms, so code built
+     against the old layout has to be rebuilt */
+  gboolean rotated;
+
   gpointer id;
 } GRect;
 
+/* x and y of a rect a packer could not place */
+#define G_RECT_UNPLACED G_MAXUINT
+
 #define G_TYPE_RECT (g_rect_get_type())
 
 GType            g_rect_get_type     (void);
@@ -76,11 +85,79 @@ gint             g_rect_fit (const GRect *outter,
 /* ************************************************************************** */
 typedef struct _GBinPacker GBinPacker;
 
+/* how full and how fragmented a packer is; all of it is kept up
+   to date as the packer goes, so it is cheap to ask for */
+typedef struct _GBinPackerStats {
+  guint64 used_area;     /* of the packed rects, without padding */
+  guint   n_free_rects;  /* the free list, the waste map's for the skyline */
+  GRect   largest_free;  /* by area, of those; for the shelves the top */
+  guint   n_segments;    /* skyline segments or shelves */
+  guint64 waste_area;    /* below the skyline or in the shelves, unpacked */
+} GBinPackerStats;
+
+/* the work a packer did, kept with the "counting" property */
+typedef struct _GBinPackerCounters {
+  guint64 scored;    /* candidate places scored */
+  guint64 merges;    /* free rects merged into a neighbour */
+  guint64 segments;  /* skyline segments visited */
+  guint64 failed;    /* rects that found no place */
+} GBinPackerCounters;
+
+typedef enum _GBinPackerTracePhase {
+  G_BIN_PACKER_TRACE_BEGIN,  /* n is the number of rects to place */
+  G_BIN_PACKER_TRACE_END,    /* n is the number of rects placed */
+} GBinPackerTracePhase;
+
+typedef void (*GBinPackerTraceFunc) (GBinPacker           *packer,
+                                     GBinPackerTracePhase  phase,
+                                     guint                 n,
+                                     gpointer              user_data);
+
 struct _GBinPackerClass
 {
   GObjectClass parent_class;
 
-  gpointer padding[13];
+  /* rect was removed from the packed ones, its space is free */
+  void (*release) (GBinPacker  *packer,
+                   const GRect *rect);
+
+  /* the size went up from old_width x old_height */
+  void (*grow)    (GBinPacker  *packer,
+                   guint        old_width,
+                   guint        old_height);
+
+  GArray * (*insert) (GBinPacker *packer,
+                      GArray     *bins);
+
+  /* place a single rect, r gets its position */
+  gboolean (*pack) (GBinPacker *packer,
+                    GRect      *r);
+
+  /* place the rects still at G_RECT_UNPLACED, the index of each
+     one placed goes to order */
+  guint (*place)    (GBinPacker *packer,
+                     GRect      *rects,
+                     guint       n_rects,
+                     guint      *order);
+
+  /* the state of the subclass in a snapshot, after the packed
+     rects; load() reads it back from data, advancing it */
+  void     (*save)  (GBinPacker    *packer,
+                     GByteArray    *out);
+  gboolean (*load)  (GBinPacker    *packer,
+                     const guint8 **data,
+                     gsize         *size);
+
+  /* append the free rects the packer searches to rects, for
+     g_bin_packer_check(); FALSE if they may overlap each other */
+  gboolean (*free_space) (GBinPacker *packer,
+                          GArray     *rects);
+
+  /* fill in the parts of stats about the free space */
+  void     (*stats) (GBinPacker      *packer,
+                     GBinPackerStats *stats);
+
+  gpointer padding[4];
 };
 
 #define G_TYPE_BIN_PACKER g_bin_packer_get_type()
@@ -88,6 +165,42 @@ G_DECLARE_DERIVABLE_TYPE(GBinPacker, g_bin_packer, G, BIN_PACKER, GObject);
 
 
 gfloat g_bin_packer_occupancy(GBinPacker *packer);
+void g_bin_packer_get_stats(GBinPacker      *packer,
+                            GBinPackerStats *stats);
+void g_bin_packer_get_counters(GBinPacker         *packer,
+                               GBinPackerCounters *counters);
+void g_bin_packer_reset_counters(GBinPacker *packer);
+void g_bin_packer_set_trace_func(GBinPacker          *packer,
+                                 GBinPackerTraceFunc  func,
+                                 gpointer             user_data);
+gboolean g_bin_packer_remove(GBinPacker *packer,
+                             gpointer    id);
+gboolean g_bin_packer_grow(GBinPacker *packer,
+                           guint       width,
+                           guint       height);
+GArray * g_bin_packer_insert(GBinPacker *packer,
+                             GArray     *bins);
+gboolean g_bin_packer_pack(GBinPacker *packer,
+                           GRect      *r);
+guint g_bin_packer_place(GBinPacker  *packer,
+                         const GRect *bins,
+                         guint        n_bins,
+                         GRect       *placed);
+GArray * g_bin_packer_check(GBinPacker *packer);
+
+/* snapshots of the whole state of a packer */
+#define G_BIN_PACKER_ERROR (g_bin_packer_error_quark())
+
+typedef enum _GBinPackerError {
+  G_BIN_PACKER_ERROR_INVALID,  /* not a snapshot or a damaged one */
+  G_BIN_PACKER_ERROR_VERSION,  /* written in a format we do not know */
+} GBinPackerError;
+
+GQuark g_bin_packer_error_quark(void);
+
+GBytes * g_bin_packer_save(GBinPacker *packer);
+GBinPacker * g_bin_packer_load(GBytes  *bytes,
+                               GError **error);
 
 
 /* ************************************************************************** */
@@ -95,19 +208,70 @@ gfloat g_bin_packer_occupancy(GBinPacker *packer);
 #define G_TYPE_GUILLOTINE_PACKER g_guillotine_packer_get_type()
 G_DECLARE_FINAL_TYPE(GGuillotinePacker, g_guillotine_packer, G, GUILLOTINE_PACKER, GBinPacker);
 
+/* for "min-free-size": park the free rects that are too narrow for
+   the narrowest bin seen so far */
+#define G_GUILLOTINE_PACKER_MIN_FREE_AUTO G_MAXUINT
+
 GArray *  g_guillotine_packer_insert   (GGuillotinePacker *gp,
 					GArray            *bins);
 gboolean  g_guillotine_packer_pack     (GGuillotinePacker *gp,
-					const GRect       *r);
+					GRect             *r);
 GArray *  g_guillotine_packer_check    (GGuillotinePacker *gp);
 
 /* ************************************************************************** */
 
+typedef enum _GSkylinePackerLevel {
+  GSP_LEVEL_BOTTOM_LEFT,
+  GSP_LEVEL_MIN_WASTE,
+} GSkylinePackerLevel;
+
 #define G_TYPE_SKYLINE_PACKER g_skyline_packer_get_type()
 G_DECLARE_FINAL_TYPE(GSkylinePacker, g_skyline_packer, G, SKYLINE_PACKER, GBinPacker);
 
 GArray *  g_skyline_packer_insert     (GSkylinePacker *sp,
                                        GArray         *bins);
+gboolean  g_skyline_packer_pack       (GSkylinePacker *sp,
+                                       GRect          *r);
+
+/* ************************************************************************** */
+
+#define G_TYPE_MAX_RECTS_PACKER g_max_rects_packer_get_type()
+G_DECLARE_FINAL_TYPE(GMaxRectsPacker, g_max_rects_packer, G, MAX_RECTS_PACKER, GBinPacker);
+
+GArray *  g_max_rects_packer_insert   (GMaxRectsPacker *mp,
+                                       GArray          *bins);
+gboolean  g_max_rects_packer_pack     (GMaxRectsPacker *mp,
+                                       GRect           *r);
+GArray *  g_max_rects_packer_check    (GMaxRectsPacker *mp);
+
+/* ************************************************************************** */
+
+#define G_TYPE_SHELF_PACKER g_shelf_packer_get_type()
+G_DECLARE_FINAL_TYPE(GShelfPacker, g_shelf_packer, G, SHELF_PACKER, GBinPacker);
+
+GArray *  g_shelf_packer_insert       (GShelfPacker *shp,
+                                       GArray       *bins);
+gboolean  g_shelf_packer_pack         (GShelfPacker *shp,
+                                       GRect        *r);
+
+/* ************************************************************************** */
+
+typedef struct _GPageRect {
+  guint page;
+  GRect rect;
+} GPageRect;
+
+#define G_TYPE_BIN_PACKER_POOL g_bin_packer_pool_get_type()
+G_DECLARE_FINAL_TYPE(GBinPackerPool, g_bin_packer_pool, G, BIN_PACKER_POOL, GObject);
+
+GArray *     g_bin_packer_pool_insert      (GBinPackerPool *pool,
+                                            GArray         *bins);
+gboolean     g_bin_packer_pool_remove      (GBinPackerPool *pool,
+                                            gpointer        id);
+guint        g_bin_packer_pool_get_n_pages (GBinPackerPool *pool);
+GBinPacker * g_bin_packer_pool_get_page    (GBinPackerPool *pool,
+                                            guint           page);
+
 /* ************************************************************************** */
 G_END_DECLS
 
@@ -336,6 +336,16 @@ draw_packed_bins(cairo_t *cr,
       cairo_glyph.y = (int) gr->y - info->ink.y;
 
       cairo_save(cr);
+
+      /* turned clockwise around the top right corner */
+      if (gr->rotated)
+        {
+          cairo_translate(cr, gr->x + gr->width, gr->y);
+          cairo_rotate(cr, G_PI / 2);
+          cairo_glyph.x = -info->ink.x;
+          cairo_glyph.y = -info->ink.y;
+        }
+
       cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
       scaled_font = pango_cairo_font_get_scaled_font(PANGO_CAIRO_FONT(info->font));
       cairo_set_scaled_font(cr, scaled_font);
@@ -422,102 +432,2566 @@ test_guillotine_packer (PackerFixture *fixture,
 }
 
 static void
-draw_skyline(cairo_t *cr,
-             GArray  *skyline,
-             double   r,
-             double   g,
-             double   b)
+test_guillotine_index (Fixture       *fixture,
+                       gconstpointer  user_data)
+{
+  GRectFit fit;
+
+  /* one bin at a time into a big atlas, so that the free list
+     grows long enough to be served from the index */
+  for (fit = G_RECT_FIT_AREA_BEST; fit <= G_RECT_FIT_LONG_SIDE_WORST; fit++)
+    {
+      GGuillotinePacker *packer;
+      GArray *bins, *packed, *rfree, *bad;
+      guint i;
+
+      packer = g_object_new(G_TYPE_GUILLOTINE_PACKER,
+                            "width", 2048,
+                            "height", 2048,
+                            "merge-free", FALSE,
+                            "fit-method", fit,
+                            NULL);
+
+      bins = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+
+      for (i = 0; i < 500; i++)
+        {
+          GRect b = {0, };
+
+          b.width  = g_test_rand_int_range(4, 40);
+          b.height = g_test_rand_int_range(4, 40);
+
+          g_array_append_val(bins, b);
+          packed = g_guillotine_packer_insert(packer, bins);
+
+          /* the "worst" heuristics shred the free space quickly,
+             only expect the "best" ones to place everything */
+          if (fit % 2 == 0)
+            g_assert_cmpuint(packed->len, ==, 1);
+
+          g_array_set_size(bins, 0);
+          g_array_free(packed, TRUE);
+        }
+
+      g_object_get(packer, "free-rects", &rfree, NULL);
+      g_assert_cmpuint(rfree->len, >, 64);
+      g_array_unref(rfree);
+
+      bad = g_guillotine_packer_check(packer);
+      g_assert_null(bad);
+
+      g_array_free(bins, TRUE);
+      g_object_unref(packer);
+    }
+}
+
+static void
+test_guillotine_exact (Fixture       *fixture,
+                       gconstpointer  user_data)
+{
+  GGuillotinePacker *packer;
+  GBinPackerCounters c;
+  GArray *bins, *packed, *rfree, *bad;
+  GRect want, r = {0, };
+  guint i, n_same = 0;
+
+  /* the row of alternating bins from test_guillotine_merge leaves
+     hundreds of free rects of the same two sizes */
+  packer = g_object_new(G_TYPE_GUILLOTINE_PACKER,
+                        "width", 4 * 1010,
+                        "height", 12,
+                        "merge-free", TRUE,
+                        "split-method", G_RECT_SPLIT_AREA_MIN,
+                        "allow-rotation", FALSE,
+                        "counting", TRUE,
+                        NULL);
+
+  bins = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+
+  for (i = 0; i < 1000; i++)
+    {
+      GRect b = {0, };
+
+      b.width  = 4;
+      b.height = 10 + i % 2;
+
+      g_array_append_val(bins, b);
+      packed = g_guillotine_packer_insert(packer, bins);
+      g_array_set_size(bins, 0);
+      g_array_free(packed, TRUE);
+    }
+
+  /* a bin the size of the slivers above the 4 x 10 bins goes into
+     the first of them, found without looking at any of the others */
+  g_object_get(packer, "free-rects", &rfree, NULL);
+  g_assert_cmpuint(rfree->len, >, 64);
+
+  want.width = 4;
+  want.height = 2;
+  for (i = rfree->len; i > 0; i--)
+    {
+      const GRect *f = &g_array_index(rfree, GRect, i - 1);
+
+      if (f->width == want.width && f->height == want.height)
+        {
+          want = *f;
+          n_same++;
+        }
+    }
+  g_array_unref(rfree);
+  g_assert_cmpuint(n_same, >, 100);
+
+  r.width = want.width;
+  r.height = want.height;
+
+  g_bin_packer_reset_counters(G_BIN_PACKER(packer));
+  g_assert_true(g_bin_packer_pack(G_BIN_PACKER(packer), &r));
+  g_assert_cmpuint(r.x, ==, want.x);
+  g_assert_cmpuint(r.y, ==, want.y);
+
+  g_bin_packer_get_counters(G_BIN_PACKER(packer), &c);
+  g_assert_cmpuint(c.scored, <=, 1);
+
+  bad = g_guillotine_packer_check(packer);
+  g_assert_null(bad);
+
+  g_array_free(bins, TRUE);
+  g_object_unref(packer);
+}
+
+static gboolean
+park_pack (GBinPacker *packer,
+           guint       id,
+           guint       width,
+           guint       height)
 {
+  GRect r = {0, };
+
+  r.width = width;
+  r.height = height;
+  r.id = GUINT_TO_POINTER(id);
+
+  return g_bin_packer_pack(packer, &r);
+}
 
+static void
+test_guillotine_park (Fixture       *fixture,
+                      gconstpointer  user_data)
+{
+  const guint sizes[] = {0, 8, G_GUILLOTINE_PACKER_MIN_FREE_AUTO};
   guint i;
-  GRect *n;
 
-  if (skyline == NULL || skyline->len < 1)
-    return;
+  /* a 16 x 12 bin in a 20 x 12 atlas leaves a 4 x 12 sliver */
+  for (i = 0; i < G_N_ELEMENTS(sizes); i++)
+    {
+      GBinPacker *packer;
+      GArray *rfree, *bad;
+      guint min_free;
+
+      packer = g_object_new(G_TYPE_GUILLOTINE_PACKER,
+                            "width", 20,
+                            "height", 12,
+                            "merge-free", TRUE,
+                            "min-free-size", sizes[i],
+                            NULL);
+
+      g_object_get(packer, "min-free-size", &min_free, NULL);
+      g_assert_cmpuint(min_free, ==, sizes[i]);
+
+      g_assert_true(park_pack(packer, 1, 16, 12));
+
+      /* parked or not, it is still free space */
+      g_object_get(packer, "free-rects", &rfree, NULL);
+      g_assert_cmpuint(rfree->len, ==, 1);
+      g_assert_cmpuint(g_array_index(rfree, GRect, 0).width, ==, 4);
+      g_array_unref(rfree);
+
+      /* only an explicit size keeps it out of reach for a smaller
+         bin, the automatic one goes down with the bins */
+      g_assert_cmpint(park_pack(packer, 2, 4, 4), ==, sizes[i] != 8);
+
+      if (sizes[i] == 8)
+        {
+          /* it merges back into something useful though */
+          g_assert_true(g_bin_packer_remove(packer, GUINT_TO_POINTER(1)));
+          g_assert_true(park_pack(packer, 3, 20, 12));
+        }
+
+      bad = g_bin_packer_check(packer);
+      g_assert_null(bad);
+
+      g_object_unref(packer);
+    }
+}
 
-  n = &g_array_index(skyline, GRect, 0);
+static void
+test_guillotine_merge (Fixture       *fixture,
+                       gconstpointer  user_data)
+{
+  const guint max_free = g_test_perf() ? 100000 : 1000;
+  GGuillotinePacker *packer;
+  GArray *bins, *packed, *rfree, *bad;
+  guint target, n = 0;
+  double ns;
+
+  /* a single row of 4 px wide bins with alternating heights: every
+     insert leaves a free sliver that cannot be merged with the one
+     next to it, so the free list grows by one each time while the
+     merge still has to look at every split */
+  packer = g_object_new(G_TYPE_GUILLOTINE_PACKER,
+                        "width", 4 * (max_free + 1000),
+                        "height", 12,
+                        "merge-free", TRUE,
+                        "split-method", G_RECT_SPLIT_AREA_MIN,
+                        NULL);
 
-  cairo_move_to(cr, 0, n->y);
-  cairo_set_line_width(cr, 1.0);
-  cairo_set_source_rgba(cr, r, g, b, 1.);
+  g_object_get(packer, "free-rects", &rfree, NULL);
+  bins = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
 
-  for (i = 0; i < skyline->len; i++)
+  for (target = 100; target <= max_free; target *= 10)
     {
-      GRect *n = &g_array_index(skyline, GRect, i);
+      guint start = n;
 
-      cairo_line_to(cr, n->x,            n->y);
-      cairo_line_to(cr, n->x + n->width, n->y);
+      g_test_timer_start();
+
+      while (rfree->len < target)
+        {
+          GRect b = {0, };
+
+          b.width  = 4;
+          b.height = 10 + n++ % 2;
+
+          g_array_append_val(bins, b);
+          packed = g_guillotine_packer_insert(packer, bins);
+          g_assert_cmpuint(packed->len, ==, 1);
+
+          g_array_set_size(bins, 0);
+          g_array_free(packed, TRUE);
+        }
+
+      ns = g_test_timer_elapsed() * 1e9 / (n - start);
+      g_test_minimized_result(ns, "%u free rects: %.1f ns per insert",
+                              target, ns);
     }
 
-  cairo_stroke(cr);
+  bad = g_guillotine_packer_check(packer);
+  g_assert_null(bad);
+
+  g_array_unref(rfree);
+  g_array_free(bins, TRUE);
+  g_object_unref(packer);
 }
 
 static void
-test_skyline_packer (PackerFixture *fixture,
-                     gconstpointer  user_data)
+test_max_rects_packer (PackerFixture *fixture,
+                       gconstpointer  user_data)
 {
   cairo_surface_t *surface;
   cairo_t *cr;
-  GSkylinePacker *packer;
+  GMaxRectsPacker *packer;
   cairo_status_t status;
-  GArray *packed, *skyline;
+  GArray *packed, *rfree, *bad;
 
   surface = fixture->surface;
   cr = fixture->cr;
 
-  packer = g_object_new(G_TYPE_SKYLINE_PACKER,
+  packer = g_object_new(G_TYPE_MAX_RECTS_PACKER,
                         "width", fixture->width,
                         "height", fixture->height,
                         NULL);
 
-  packed = g_skyline_packer_insert(packer, fixture->bins);
-  g_debug("Packing done [%u bins packed]\n",
-          packed->len);
+  packed = g_max_rects_packer_insert(packer, fixture->bins);
+
+  g_object_get(packer,
+               "free-rects", &rfree,
+               NULL);
+
+  g_debug("Packing done [%u bins packed, %u free]\n",
+          packed->len, rfree->len);
 
+  draw_rects(cr, rfree, 0.0, 0.0, 1.0);
   draw_packed_bins(cr, packed);
 
-  g_object_get(packer, "skyline", &skyline, NULL);
-  draw_skyline(cr, skyline, 0.0, 0.0, 1.0);
+  /* consistency check */
+  bad = g_max_rects_packer_check(packer);
+  draw_rects(cr, bad, 1.0, 0.0, 0.0);
 
   cairo_surface_flush(surface);
-  status = cairo_surface_write_to_png(surface, "skyline.png");
+  status = cairo_surface_write_to_png(surface, "max-rects.png");
 
+  g_assert_null(bad);
+
+  g_array_unref(rfree);
   g_object_unref(packer);
   g_assert_true(status == CAIRO_STATUS_SUCCESS);
 }
 
+/* MaxRects has no index, every placement scans all of the free
+   list; how that scales once the list gets long */
+static void
+test_max_rects_scan (Fixture       *fixture,
+                     gconstpointer  user_data)
+{
+  const guint side = g_test_perf() ? 2048 : 256;
+  GMaxRectsPacker *packer;
+  GArray *rfree;
+  GRand *rand;
+  guint target, n = 0;
+
+  packer = g_object_new(G_TYPE_MAX_RECTS_PACKER,
+                        "width", side,
+                        "height", side,
+                        NULL);
 
-int
-main (int argc, char **argv)
+  g_object_get(packer, "free-rects", &rfree, NULL);
+  rand = g_rand_new_with_seed(5);
+
+  for (target = 250; target <= side * 2; target *= 2)
+    {
+      guint start = n;
+      double ns;
+
+      g_test_timer_start();
+
+      while (rfree->len < target)
+        {
+          GRect r = {0, };
+
+          r.width  = g_rand_int_range(rand, 2, 12);
+          r.height = g_rand_int_range(rand, 4, 12);
+
+          if (!g_max_rects_packer_pack(packer, &r))
+            break;
+
+          n++;
+        }
+
+      if (n == start)
+        break;
+
+      ns = g_test_timer_elapsed() * 1e9 / (n - start);
+      g_test_minimized_result(ns, "%u free rects: %.1f ns per pack",
+                              rfree->len, ns);
+    }
+
+  g_assert_cmpuint(n, >, 0);
+  g_assert_null(g_max_rects_packer_check(packer));
+
+  g_rand_free(rand);
+  g_array_unref(rfree);
+  g_object_unref(packer);
+}
+
+static void
+test_shelf_packer (PackerFixture *fixture,
+                   gconstpointer  user_data)
 {
-  setlocale(LC_ALL, "");
+  const guint rounds = g_test_perf() ? 200 : 1;
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  GShelfPacker *packer = NULL;
+  cairo_status_t status;
+  GArray *packed, *one;
+  gdouble elapsed = 0;
+  guint i, k;
 
-  g_test_init(&argc, &argv, NULL);
+  surface = fixture->surface;
+  cr = fixture->cr;
 
-  g_test_add("/bin-packer/rect",
-	     Fixture, NULL,
-	     NULL,
-	     test_rect_basic,
-	     NULL);
+  one = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+  packed = g_array_sized_new(FALSE, FALSE, sizeof(GRect), fixture->bins->len);
 
-  g_test_add("/bin-packer/rect/merge",
-	     Fixture, NULL,
-	     NULL,
-	     test_rect_merge,
-	     NULL);
+  /* one glyph at a time, as they show up during a frame */
+  for (k = 0; k < rounds; k++)
+    {
+      g_clear_object(&packer);
+      g_array_set_size(packed, 0);
 
-  /* the packers */
-  g_test_add("/bin-packer/packer/guillotine",
-             PackerFixture, NULL,
-             fixture_set_up,
-             test_guillotine_packer,
-             fixture_tear_down);
+      packer = g_object_new(G_TYPE_SHELF_PACKER,
+                            "width", fixture->width,
+                            "height", fixture->height,
+                            NULL);
 
-  g_test_add("/bin-packer/packer/skyline",
-             PackerFixture, NULL,
-             fixture_set_up,
-             test_skyline_packer,
-             fixture_tear_down);
+      g_test_timer_start();
+
+      for (i = 0; i < fixture->bins->len; i++)
+        {
+          GArray *out;
+
+          g_array_set_size(one, 0);
+          g_array_append_vals(one, &g_array_index(fixture->bins, GRect, i), 1);
+
+          out = g_shelf_packer_insert(packer, one);
+          g_array_append_vals(packed, out->data, out->len);
+          g_array_free(out, TRUE);
+        }
+
+      elapsed += g_test_timer_elapsed();
+    }
+
+  g_test_minimized_result(elapsed * 1e9 / (rounds * fixture->bins->len),
+                          "shelf: %.1f ns per glyph",
+                          elapsed * 1e9 / (rounds * fixture->bins->len));
+
+  draw_packed_bins(cr, packed);
+
+  for (i = 0; i < packed->len; i++)
+    {
+      const GRect *a = &g_array_index(packed, GRect, i);
+
+      g_assert_cmpuint(a->x + a->width, <=, fixture->width);
+      g_assert_cmpuint(a->y + a->height, <=, fixture->height);
+
+      for (k = i + 1; k < packed->len; k++)
+        {
+          const GRect *b = &g_array_index(packed, GRect, k);
+          GRect o;
+
+          g_assert_false(g_rect_intersect(a, b, &o));
+        }
+    }
+
+  cairo_surface_flush(surface);
+  status = cairo_surface_write_to_png(surface, "shelf.png");
+
+  g_array_free(packed, TRUE);
+  g_array_free(one, TRUE);
+  g_object_unref(packer);
+  g_assert_true(status == CAIRO_STATUS_SUCCESS);
+}
+
+static GBinPacker *
+tile_packer_new (GType    type,
+                 gboolean use_wm)
+{
+  if (type == G_TYPE_SKYLINE_PACKER)
+    return g_object_new(type,
+                        "width", 64,
+                        "height", 64,
+                        "use-wastemap", use_wm,
+                        NULL);
+
+  return g_object_new(type,
+                      "width", 64,
+                      "height", 64,
+                      NULL);
+}
+
+static gboolean
+tile_insert (GBinPacker *packer,
+             guint       id,
+             GRect      *placed)
+{
+  GRect b = {0, };
+  GArray *bins, *out;
+  gboolean res;
+
+  b.width = b.height = 16;
+  b.id = GUINT_TO_POINTER(id);
+
+  bins = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+  g_array_append_val(bins, b);
+
+  out = g_bin_packer_insert(packer, bins);
+
+  res = out->len == 1;
+
+  if (res && placed)
+    *placed = g_array_index(out, GRect, 0);
+
+  g_array_free(out, TRUE);
+  g_array_free(bins, TRUE);
+
+  return res;
+}
+
+/* the offset of the first run of n little endian words in data */
+static gssize
+find_words(const guint8  *data,
+           gsize          size,
+           const guint32 *words,
+           guint          n)
+{
+  guint32 le[8];
+  gsize i;
+
+  g_assert_cmpuint(n, <=, G_N_ELEMENTS(le));
+
+  for (i = 0; i < n; i++)
+    le[i] = GUINT32_TO_LE(words[i]);
+
+  for (i = 0; i + n * sizeof(guint32) <= size; i++)
+    if (memcmp(data + i, le, n * sizeof(guint32)) == 0)
+      return i;
+
+  return -1;
+}
+
+/* fill a 256x256 atlas with glyph sized rects and take all of
+   them but the first keep away again, after which the whole atlas
+   must be free, or at least a quarter of it with some left */
+static void
+empty_packer_check (GBinPacker *packer,
+                    guint       keep)
+{
+  GRand *rand = g_rand_new_with_seed(17);
+  GArray *bins, *out;
+  GRect b = {0, };
+  guint i;
+
+  bins = g_array_new(FALSE, FALSE, sizeof(GRect));
+
+  for (i = 0; i < 2000; i++)
+    {
+      b.width  = g_rand_int_range(rand, 4, 21);
+      b.height = g_rand_int_range(rand, 4, 21);
+      b.id = GUINT_TO_POINTER(i + 1);
+      g_array_append_val(bins, b);
+    }
+
+  out = g_bin_packer_insert(packer, bins);
+  g_assert_cmpuint(out->len, <, bins->len);
+
+  for (i = keep; i < out->len; i++)
+    g_assert_true(g_bin_packer_remove(packer,
+                                      g_array_index(out, GRect, i).id));
+
+  if (keep == 0)
+    g_assert_cmpfloat(g_bin_packer_occupancy(packer), ==, 0.0);
+
+  g_assert_null(g_bin_packer_check(packer));
+  g_array_free(out, TRUE);
+
+  b.width = b.height = keep > 0 ? 128 : 256;
+  b.id = GUINT_TO_POINTER(2001);
+  g_array_set_size(bins, 0);
+  g_array_append_val(bins, b);
+
+  out = g_bin_packer_insert(packer, bins);
+  g_assert_cmpuint(out->len, ==, 1);
+
+  g_array_free(out, TRUE);
+  g_array_free(bins, TRUE);
+  g_rand_free(rand);
+}
+
+static void
+test_packer_remove (Fixture       *fixture,
+                    gconstpointer  user_data)
+{
+  struct {
+    GType    type;
+    gboolean use_wm;
+    gboolean holes;  /* reuses space below other rects */
+  } packers[] = {
+    {G_TYPE_GUILLOTINE_PACKER, FALSE, TRUE},
+    {G_TYPE_SKYLINE_PACKER,    FALSE, FALSE},
+    {G_TYPE_SKYLINE_PACKER,    TRUE,  TRUE},
+    {G_TYPE_MAX_RECTS_PACKER,  FALSE, TRUE},
+    {G_TYPE_SHELF_PACKER,      FALSE, FALSE},
+  };
+  GBinPacker *packer;
+  guint p;
+
+  for (p = 0; p < G_N_ELEMENTS(packers); p++)
+    {
+      GRect tiles[16], again;
+      guint i;
+
+      packer = tile_packer_new(packers[p].type, packers[p].use_wm);
+
+      /* fill the atlas up completely */
+      for (i = 0; i < 16; i++)
+        g_assert_true(tile_insert(packer, i, &tiles[i]));
+
+      g_assert_false(tile_insert(packer, 16, NULL));
+
+      /* the last one is always on top */
+      g_assert_true(g_bin_packer_remove(packer, GUINT_TO_POINTER(15)));
+      g_assert_false(g_bin_packer_remove(packer, GUINT_TO_POINTER(15)));
+
+      g_assert_true(tile_insert(packer, 15, &again));
+      g_assert_cmpuint(again.x, ==, tiles[15].x);
+      g_assert_cmpuint(again.y, ==, tiles[15].y);
+
+      /* one in the middle of the atlas */
+      g_assert_true(g_bin_packer_remove(packer, GUINT_TO_POINTER(5)));
+      g_assert_cmpint(tile_insert(packer, 5, &again), ==, packers[p].holes);
+
+      if (packers[p].holes)
+        {
+          g_assert_cmpuint(again.x, ==, tiles[5].x);
+          g_assert_cmpuint(again.y, ==, tiles[5].y);
+        }
+
+      g_assert_cmpfloat(g_bin_packer_occupancy(packer), ==,
+                        packers[p].holes ? 1.0 : 15.0 / 16.0);
+
+      if (packers[p].use_wm)
+        {
+          guint32 words[7];
+          GBytes *snap;
+          gsize size;
+          const guint8 *data;
+
+          /* take away everything above the one that went into the
+             waste map, its top is the skyline then, and once it is
+             gone the waste map must have forgotten it as well */
+          for (i = 16; i > 0; i--)
+            if (tiles[i - 1].x == again.x && tiles[i - 1].y > again.y)
+              g_assert_true(g_bin_packer_remove(packer, GUINT_TO_POINTER(i - 1)));
+
+          g_assert_true(g_bin_packer_remove(packer, GUINT_TO_POINTER(5)));
+
+          words[0] = again.x;
+          words[1] = again.y;
+          words[2] = again.width;
+          words[3] = again.height;
+          words[4] = again.rotated;
+          words[5] = 5; /* the id, as a 64 bit number */
+          words[6] = 0;
+
+          snap = g_bin_packer_save(packer);
+          data = g_bytes_get_data(snap, &size);
+          g_assert_cmpint(find_words(data, size, words, 7), ==, -1);
+          g_bytes_unref(snap);
+        }
+
+      g_object_unref(packer);
+    }
+
+  for (p = 0; p < G_N_ELEMENTS(packers); p++)
+    {
+      guint n_keep;
+      guint keep;
+
+      /* without a waste map the holes in the skyline stay holes
+         until everything is gone, the empty shelves on top of the
+         first few rects do go away */
+      n_keep = packers[p].holes ||
+               packers[p].type == G_TYPE_SHELF_PACKER ? 3 : 1;
+
+      for (keep = 0; keep < n_keep; keep++)
+        {
+          if (packers[p].type == G_TYPE_SKYLINE_PACKER)
+            packer = g_object_new(packers[p].type,
+                                  "width", 256,
+                                  "height", 256,
+                                  "use-wastemap", packers[p].use_wm,
+                                  NULL);
+          else
+            packer = g_object_new(packers[p].type,
+                                  "width", 256,
+                                  "height", 256,
+                                  NULL);
+
+          empty_packer_check(packer, keep);
+          g_object_unref(packer);
+        }
+    }
+
+  /* nor does the guillotine merge them */
+  packer = g_object_new(G_TYPE_GUILLOTINE_PACKER,
+                        "width", 256,
+                        "height", 256,
+                        "merge-free", FALSE,
+                        NULL);
+  empty_packer_check(packer, 0);
+  g_object_unref(packer);
+
+  /* an id that was packed twice has to be removed twice */
+  for (p = 0; p < G_N_ELEMENTS(packers); p++)
+    {
+      guint ids[] = {7, 3, 7, 3, 9};
+      guint i;
+
+      packer = tile_packer_new(packers[p].type, packers[p].use_wm);
+
+      for (i = 0; i < G_N_ELEMENTS(ids); i++)
+        g_assert_true(tile_insert(packer, ids[i], NULL));
+
+      g_assert_true(g_bin_packer_remove(packer, GUINT_TO_POINTER(7)));
+      g_assert_true(g_bin_packer_remove(packer, GUINT_TO_POINTER(3)));
+      g_assert_true(g_bin_packer_remove(packer, GUINT_TO_POINTER(7)));
+      g_assert_false(g_bin_packer_remove(packer, GUINT_TO_POINTER(7)));
+      g_assert_cmpfloat(g_bin_packer_occupancy(packer), ==, 2.0 / 16.0);
+
+      g_assert_true(g_bin_packer_remove(packer, GUINT_TO_POINTER(9)));
+      g_assert_true(g_bin_packer_remove(packer, GUINT_TO_POINTER(3)));
+      g_assert_false(g_bin_packer_remove(packer, GUINT_TO_POINTER(3)));
+      g_assert_cmpfloat(g_bin_packer_occupancy(packer), ==, 0.0);
+      g_assert_null(g_bin_packer_check(packer));
+
+      g_object_unref(packer);
+    }
+}
+
+static void
+test_packer_grow (Fixture       *fixture,
+                  gconstpointer  user_data)
+{
+  struct {
+    GType    type;
+    gboolean use_wm;
+  } packers[] = {
+    {G_TYPE_GUILLOTINE_PACKER, FALSE},
+    {G_TYPE_SKYLINE_PACKER,    FALSE},
+    {G_TYPE_SKYLINE_PACKER,    TRUE},
+    {G_TYPE_MAX_RECTS_PACKER,  FALSE},
+    {G_TYPE_SHELF_PACKER,      FALSE},
+  };
+  guint p;
+
+  for (p = 0; p < G_N_ELEMENTS(packers); p++)
+    {
+      GBinPacker *packer;
+      GRect tiles[16];
+      GArray *rects;
+      guint width;
+      guint i;
+
+      packer = tile_packer_new(packers[p].type, packers[p].use_wm);
+
+      for (i = 0; i < 16; i++)
+        g_assert_true(tile_insert(packer, i, &tiles[i]));
+
+      g_assert_false(tile_insert(packer, 16, NULL));
+
+      g_assert_false(g_bin_packer_grow(packer, 32, 128));
+      g_assert_true(g_bin_packer_grow(packer, 128, 128));
+
+      g_object_get(packer, "width", &width, "rects", &rects, NULL);
+      g_assert_cmpuint(width, ==, 128);
+
+      /* everything stays where it was */
+      g_assert_cmpuint(rects->len, ==, 16);
+      for (i = 0; i < 16; i++)
+        {
+          const GRect *r = &g_array_index(rects, GRect, i);
+
+          g_assert_cmpuint(r->x, ==, tiles[i].x);
+          g_assert_cmpuint(r->y, ==, tiles[i].y);
+        }
+
+      g_array_unref(rects);
+
+      /* and the new space can be filled up completely */
+      for (i = 16; i < 64; i++)
+        g_assert_true(tile_insert(packer, i, NULL));
+
+      g_assert_false(tile_insert(packer, 64, NULL));
+      g_assert_cmpfloat(g_bin_packer_occupancy(packer), ==, 1.0);
+
+      g_object_unref(packer);
+    }
+}
+
+/* packed rects are stored with 16 bit coordinates until one does
+   not fit into that any more */
+static void
+test_packer_wide (Fixture       *fixture,
+                  gconstpointer  user_data)
+{
+  GBinPacker *packer;
+  GArray *rects;
+  guint i;
+
+  packer = g_object_new(G_TYPE_SHELF_PACKER,
+                        "width", 100000,
+                        "height", 64,
+                        NULL);
+
+  for (i = 0; i < 10; i++)
+    {
+      GRect r = {0, };
+
+      r.width = 10000;
+      r.height = 16;
+      r.id = GUINT_TO_POINTER(i);
+
+      g_assert_true(g_bin_packer_pack(packer, &r));
+      g_assert_cmpuint(r.x, ==, i * 10000);
+    }
+
+  g_object_get(packer, "rects", &rects, NULL);
+  g_assert_cmpuint(rects->len, ==, 10);
+
+  for (i = 0; i < rects->len; i++)
+    {
+      const GRect *r = &g_array_index(rects, GRect, i);
+
+      g_assert_cmpuint(r->x, ==, i * 10000);
+      g_assert_cmpuint(r->width, ==, 10000);
+      g_assert_true(r->id == GUINT_TO_POINTER(i));
+    }
+
+  g_array_unref(rects);
+
+  g_assert_cmpfloat(g_bin_packer_occupancy(packer), ==, 0.25);
+  g_assert_true(g_bin_packer_remove(packer, GUINT_TO_POINTER(9)));
+  g_assert_true(g_bin_packer_remove(packer, GUINT_TO_POINTER(3)));
+  g_assert_false(g_bin_packer_remove(packer, GUINT_TO_POINTER(9)));
+  g_assert_cmpfloat(g_bin_packer_occupancy(packer), ==, (gfloat) 0.2);
+
+  g_object_unref(packer);
+}
+
+static void
+test_packer_pool (Fixture       *fixture,
+                  gconstpointer  user_data)
+{
+  GBinPackerPool *pool;
+  GArray *bins, *placed;
+  GPageRect *pr;
+  guint count[3] = {0, };
+  gpointer first = NULL;
+  guint i;
+
+  pool = g_object_new(G_TYPE_BIN_PACKER_POOL,
+                      "packer-type", G_TYPE_GUILLOTINE_PACKER,
+                      "width", 64,
+                      "height", 64,
+                      NULL);
+
+  bins = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 40);
+
+  /* 16 tiles fill a page */
+  for (i = 0; i < 40; i++)
+    {
+      GRect b = {0, };
+
+      b.width = b.height = 16;
+      b.id = GUINT_TO_POINTER(i);
+      g_array_append_val(bins, b);
+    }
+
+  placed = g_bin_packer_pool_insert(pool, bins);
+  g_assert_cmpuint(placed->len, ==, 40);
+  g_assert_cmpuint(bins->len, ==, 0);
+  g_assert_cmpuint(g_bin_packer_pool_get_n_pages(pool), ==, 3);
+
+  for (i = 0; i < placed->len; i++)
+    {
+      pr = &g_array_index(placed, GPageRect, i);
+      g_assert_cmpuint(pr->page, <, 3);
+      count[pr->page]++;
+
+      if (pr->page == 0 && first == NULL)
+        first = pr->rect.id;
+    }
+
+  g_assert_cmpuint(count[0], ==, 16);
+  g_assert_cmpuint(count[1], ==, 16);
+  g_assert_cmpuint(count[2], ==, 8);
+  g_array_free(placed, TRUE);
+
+  /* too big for any page, must not leave an empty page behind */
+  g_array_set_size(bins, 1);
+  g_array_index(bins, GRect, 0).width = 65;
+
+  placed = g_bin_packer_pool_insert(pool, bins);
+  g_assert_cmpuint(placed->len, ==, 0);
+  g_assert_cmpuint(bins->len, ==, 1);
+  g_assert_cmpuint(g_bin_packer_pool_get_n_pages(pool), ==, 3);
+  g_array_free(placed, TRUE);
+
+  /* freed space on the first page is used first */
+  g_assert_true(g_bin_packer_pool_remove(pool, first));
+  g_assert_false(g_bin_packer_pool_remove(pool, first));
+
+  g_array_index(bins, GRect, 0).width = 16;
+
+  placed = g_bin_packer_pool_insert(pool, bins);
+  g_assert_cmpuint(placed->len, ==, 1);
+  g_assert_cmpuint(g_array_index(placed, GPageRect, 0).page, ==, 0);
+  g_array_free(placed, TRUE);
+
+  g_array_free(bins, TRUE);
+  g_object_unref(pool);
+}
+
+static GBinPacker *
+glyph_packer_new (GType    type,
+                  gboolean use_wm)
+{
+  if (type == G_TYPE_SKYLINE_PACKER)
+    return g_object_new(type,
+                        "width", 512,
+                        "height", 512,
+                        "use-wastemap", use_wm,
+                        NULL);
+
+  return g_object_new(type,
+                      "width", 512,
+                      "height", 512,
+                      NULL);
+}
+
+/* fill a fresh packer with glyphs one at a time, through pack() or
+   through a single bin insert(); returns the number packed */
+static guint
+glyph_fill (GType        type,
+            gboolean     use_wm,
+            const GRect *glyphs,
+            guint        n_glyphs,
+            gboolean     use_pack,
+            GRect       *placed)
+{
+  GBinPacker *packer = glyph_packer_new(type, use_wm);
+  GArray *bins = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+  guint n;
+
+  for (n = 0; n < n_glyphs; n++)
+    {
+      GRect r = glyphs[n];
+
+      if (use_pack)
+        {
+          if (!g_bin_packer_pack(packer, &r))
+            break;
+        }
+      else
+        {
+          GArray *out;
+
+          g_array_append_val(bins, r);
+          out = g_bin_packer_insert(packer, bins);
+
+          if (out->len == 0)
+            {
+              g_array_free(out, TRUE);
+              break;
+            }
+
+          r = g_array_index(out, GRect, 0);
+          g_array_free(out, TRUE);
+        }
+
+      if (placed)
+        placed[n] = r;
+    }
+
+  g_array_free(bins, TRUE);
+  g_object_unref(packer);
+
+  return n;
+}
+
+static void
+test_packer_pack (Fixture       *fixture,
+                  gconstpointer  user_data)
+{
+  struct {
+    GType    type;
+    gboolean use_wm;
+  } packers[] = {
+    {G_TYPE_GUILLOTINE_PACKER, FALSE},
+    {G_TYPE_SKYLINE_PACKER,    FALSE},
+    {G_TYPE_SKYLINE_PACKER,    TRUE},
+    {G_TYPE_MAX_RECTS_PACKER,  FALSE},
+    {G_TYPE_SHELF_PACKER,      FALSE},
+  };
+  const guint n_glyphs = 4096;
+  const guint rounds = g_test_perf() ? 20 : 1;
+  GRect *glyphs, *by_pack, *by_insert;
+  GRand *rand;
+  guint i, p;
+
+  glyphs = g_new0(GRect, n_glyphs);
+  by_pack = g_new0(GRect, n_glyphs);
+  by_insert = g_new0(GRect, n_glyphs);
+
+  rand = g_rand_new_with_seed(42);
+
+  for (i = 0; i < n_glyphs; i++)
+    {
+      glyphs[i].width  = g_rand_int_range(rand, 4, 24);
+      glyphs[i].height = g_rand_int_range(rand, 8, 24);
+      glyphs[i].id = GUINT_TO_POINTER(i);
+    }
+
+  for (p = 0; p < G_N_ELEMENTS(packers); p++)
+    {
+      GType type = packers[p].type;
+      gboolean use_wm = packers[p].use_wm;
+      double t_pack, t_insert;
+      guint n, round;
+
+      /* both paths place every glyph at the same spot */
+      n = glyph_fill(type, use_wm, glyphs, n_glyphs, TRUE, by_pack);
+      g_assert_cmpuint(n, >, 0);
+      g_assert_cmpuint(n, <, n_glyphs);
+      g_assert_cmpuint(glyph_fill(type, use_wm, glyphs, n_glyphs,
+                                  FALSE, by_insert), ==, n);
+
+      for (i = 0; i < n; i++)
+        {
+          g_assert_cmpuint(by_pack[i].x, ==, by_insert[i].x);
+          g_assert_cmpuint(by_pack[i].y, ==, by_insert[i].y);
+          g_assert_true(by_pack[i].id == by_insert[i].id);
+        }
+
+      g_test_timer_start();
+      for (round = 0; round < rounds; round++)
+        glyph_fill(type, use_wm, glyphs, n_glyphs, TRUE, NULL);
+      t_pack = g_test_timer_elapsed() * 1e9 / (rounds * n);
+
+      g_test_timer_start();
+      for (round = 0; round < rounds; round++)
+        glyph_fill(type, use_wm, glyphs, n_glyphs, FALSE, NULL);
+      t_insert = g_test_timer_elapsed() * 1e9 / (rounds * n);
+
+      g_test_minimized_result(t_pack,
+                              "%s%s: %.1f ns per pack, %.1f ns per insert",
+                              g_type_name(type),
+                              use_wm ? " (wastemap)" : "",
+                              t_pack, t_insert);
+    }
+
+  g_rand_free(rand);
+  g_free(glyphs);
+  g_free(by_pack);
+  g_free(by_insert);
+}
+
+static void
+test_packer_place (Fixture       *fixture,
+                   gconstpointer  user_data)
+{
+  struct {
+    GType    type;
+    gboolean use_wm;
+  } packers[] = {
+    {G_TYPE_GUILLOTINE_PACKER, FALSE},
+    {G_TYPE_SKYLINE_PACKER,    FALSE},
+    {G_TYPE_SKYLINE_PACKER,    TRUE},
+    {G_TYPE_MAX_RECTS_PACKER,  FALSE},
+    {G_TYPE_SHELF_PACKER,      FALSE},
+  };
+  const guint n_bins = 400;
+  GRect *bins, *placed;
+  GRand *rand;
+  guint i, p;
+
+  bins = g_new0(GRect, n_bins);
+  placed = g_new0(GRect, n_bins);
+
+  rand = g_rand_new_with_seed(7);
+
+  for (i = 0; i < n_bins; i++)
+    {
+      bins[i].width  = g_rand_int_range(rand, 16, 48);
+      bins[i].height = g_rand_int_range(rand, 16, 48);
+      bins[i].id = GUINT_TO_POINTER(i);
+    }
+
+  for (p = 0; p < G_N_ELEMENTS(packers); p++)
+    {
+      GBinPacker *a, *b;
+      GArray *rest, *out;
+      guint n, n_unplaced = 0;
+
+      a = glyph_packer_new(packers[p].type, packers[p].use_wm);
+      b = glyph_packer_new(packers[p].type, packers[p].use_wm);
+
+      n = g_bin_packer_place(a, bins, n_bins, placed);
+      g_assert_cmpuint(n, >, 0);
+      g_assert_cmpuint(n, <, n_bins);
+
+      /* same as going through insert() */
+      rest = g_array_sized_new(FALSE, FALSE, sizeof(GRect), n_bins);
+      g_array_append_vals(rest, bins, n_bins);
+      out = g_bin_packer_insert(b, rest);
+      g_assert_cmpuint(out->len, ==, n);
+      g_assert_cmpuint(rest->len, ==, n_bins - n);
+
+      for (i = 0; i < out->len; i++)
+        {
+          const GRect *r = &g_array_index(out, GRect, i);
+          const GRect *q = &placed[GPOINTER_TO_UINT(r->id)];
+
+          g_assert_cmpuint(q->x, ==, r->x);
+          g_assert_cmpuint(q->y, ==, r->y);
+        }
+
+      /* bins is left alone, placed is indexed like it */
+      for (i = 0; i < n_bins; i++)
+        {
+          g_assert_cmpuint(bins[i].x, ==, 0);
+          g_assert_true(placed[i].id == bins[i].id);
+          g_assert_cmpuint(placed[i].width, ==, bins[i].width);
+
+          if (placed[i].x == G_RECT_UNPLACED)
+            {
+              g_assert_cmpuint(placed[i].y, ==, G_RECT_UNPLACED);
+              g_assert_true(g_array_index(rest, GRect, n_unplaced).id == bins[i].id);
+              n_unplaced++;
+            }
+        }
+
+      g_assert_cmpuint(n_unplaced, ==, n_bins - n);
+      g_assert_cmpfloat(g_bin_packer_occupancy(a), ==,
+                        g_bin_packer_occupancy(b));
+
+      g_array_free(out, TRUE);
+      g_array_free(rest, TRUE);
+      g_object_unref(a);
+      g_object_unref(b);
+    }
+
+  /* placing in place */
+  {
+    GBinPacker *a = glyph_packer_new(G_TYPE_MAX_RECTS_PACKER, FALSE);
+    guint n;
+
+    memcpy(placed, bins, n_bins * sizeof(GRect));
+    n = g_bin_packer_place(a, placed, 50, placed);
+    g_assert_cmpuint(n, ==, 50);
+
+    for (i = 0; i < 50; i++)
+      g_assert_cmpuint(placed[i].x, !=, G_RECT_UNPLACED);
+
+    g_object_unref(a);
+  }
+
+  g_rand_free(rand);
+  g_free(bins);
+  g_free(placed);
+}
+
+static void
+test_packer_compare (PackerFixture *fixture,
+                     gconstpointer  user_data)
+{
+  const guint rounds = g_test_perf() ? 50 : 1;
+  const char *names[] = {"guillotine", "skyline", "max-rects", "shelf"};
+  guint p;
+
+  /* half the usual atlas so that the glyphs do not all fit */
+  for (p = 0; p < G_N_ELEMENTS(names); p++)
+    {
+      gdouble elapsed = 0;
+      gfloat occupancy = 0;
+      guint n_packed = 0;
+      guint i;
+
+      for (i = 0; i < rounds; i++)
+        {
+          GBinPacker *packer;
+          GArray *bins, *packed;
+
+          bins = g_array_sized_new(FALSE, FALSE, sizeof(GRect),
+                                   fixture->bins->len);
+          g_array_append_vals(bins, fixture->bins->data, fixture->bins->len);
+
+          g_test_timer_start();
+
+          switch (p)
+            {
+            case 0:
+              packer = g_object_new(G_TYPE_GUILLOTINE_PACKER,
+                                    "width", fixture->width,
+                                    "height", fixture->height / 2,
+                                    "fit-method", G_RECT_FIT_SHORT_SIDE_BEST,
+                                    NULL);
+              packed = g_guillotine_packer_insert(G_GUILLOTINE_PACKER(packer), bins);
+              break;
+
+            case 1:
+              packer = g_object_new(G_TYPE_SKYLINE_PACKER,
+                                    "width", fixture->width,
+                                    "height", fixture->height / 2,
+                                    NULL);
+              packed = g_skyline_packer_insert(G_SKYLINE_PACKER(packer), bins);
+              break;
+
+            case 2:
+              packer = g_object_new(G_TYPE_MAX_RECTS_PACKER,
+                                    "width", fixture->width,
+                                    "height", fixture->height / 2,
+                                    NULL);
+              packed = g_max_rects_packer_insert(G_MAX_RECTS_PACKER(packer), bins);
+              break;
+
+            default:
+              packer = g_object_new(G_TYPE_SHELF_PACKER,
+                                    "width", fixture->width,
+                                    "height", fixture->height / 2,
+                                    NULL);
+              packed = g_shelf_packer_insert(G_SHELF_PACKER(packer), bins);
+              break;
+            }
+
+          elapsed += g_test_timer_elapsed();
+
+          n_packed = packed->len;
+          occupancy = g_bin_packer_occupancy(packer);
+
+          g_array_free(packed, TRUE);
+          g_array_free(bins, TRUE);
+          g_object_unref(packer);
+        }
+
+      g_test_message("%s: %u of %u bins, occupancy %.3f, %.1f us per atlas",
+                     names[p], n_packed, fixture->bins->len,
+                     occupancy, elapsed * 1e6 / rounds);
+
+      g_test_maximized_result(occupancy, "%s: occupancy %.3f",
+                              names[p], occupancy);
+    }
+}
+
+static void
+draw_skyline(cairo_t *cr,
+             GArray  *skyline,
+             double   r,
+             double   g,
+             double   b)
+{
+
+  guint i;
+  GRect *n;
+
+  if (skyline == NULL || skyline->len < 1)
+    return;
+
+  n = &g_array_index(skyline, GRect, 0);
+
+  cairo_move_to(cr, 0, n->y);
+  cairo_set_line_width(cr, 1.0);
+  cairo_set_source_rgba(cr, r, g, b, 1.);
+
+  for (i = 0; i < skyline->len; i++)
+    {
+      GRect *n = &g_array_index(skyline, GRect, i);
+
+      cairo_line_to(cr, n->x,            n->y);
+      cairo_line_to(cr, n->x + n->width, n->y);
+    }
+
+  cairo_stroke(cr);
+}
+
+static void
+test_skyline_packer (PackerFixture *fixture,
+                     gconstpointer  user_data)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  GSkylinePacker *packer;
+  cairo_status_t status;
+  GArray *packed, *skyline;
+
+  surface = fixture->surface;
+  cr = fixture->cr;
+
+  packer = g_object_new(G_TYPE_SKYLINE_PACKER,
+                        "width", fixture->width,
+                        "height", fixture->height,
+                        NULL);
+
+  packed = g_skyline_packer_insert(packer, fixture->bins);
+  g_debug("Packing done [%u bins packed]\n",
+          packed->len);
+
+  draw_packed_bins(cr, packed);
+
+  g_object_get(packer, "skyline", &skyline, NULL);
+  draw_skyline(cr, skyline, 0.0, 0.0, 1.0);
+
+  cairo_surface_flush(surface);
+  status = cairo_surface_write_to_png(surface, "skyline.png");
+
+  g_object_unref(packer);
+  g_assert_true(status == CAIRO_STATUS_SUCCESS);
+}
+
+static void
+test_skyline_level (PackerFixture *fixture,
+                    gconstpointer  user_data)
+{
+  const guint rounds = g_test_perf() ? 200 : 1;
+  const char *names[] = {"bottom-left", "min-waste"};
+  GSkylinePackerLevel level;
+
+  /* compare the level heuristics on the glyphs of the fixture */
+  for (level = GSP_LEVEL_BOTTOM_LEFT; level <= GSP_LEVEL_MIN_WASTE; level++)
+    {
+      gdouble elapsed = 0;
+      gfloat occupancy = 0;
+      guint n_packed = 0;
+      guint i;
+
+      for (i = 0; i < rounds; i++)
+        {
+          GSkylinePacker *packer;
+          GArray *bins, *packed;
+
+          packer = g_object_new(G_TYPE_SKYLINE_PACKER,
+                                "width", fixture->width,
+                                "height", fixture->height,
+                                "level", level,
+                                NULL);
+
+          bins = g_array_sized_new(FALSE, FALSE, sizeof(GRect),
+                                   fixture->bins->len);
+          g_array_append_vals(bins, fixture->bins->data, fixture->bins->len);
+
+          g_test_timer_start();
+          packed = g_skyline_packer_insert(packer, bins);
+          elapsed += g_test_timer_elapsed();
+
+          g_assert_cmpuint(packed->len + bins->len, ==, fixture->bins->len);
+
+          n_packed = packed->len;
+          occupancy = g_bin_packer_occupancy(G_BIN_PACKER(packer));
+
+          g_array_free(packed, TRUE);
+          g_array_free(bins, TRUE);
+          g_object_unref(packer);
+        }
+
+      g_test_message("%s: %u of %u bins, occupancy %.3f, %.1f us per atlas",
+                     names[level], n_packed, fixture->bins->len,
+                     occupancy, elapsed * 1e6 / rounds);
+
+      g_test_maximized_result(n_packed * rounds / elapsed,
+                              "%s: %.0f bins per second",
+                              names[level], n_packed * rounds / elapsed);
+    }
+}
+
+/* the area wasted below a wide rect can take more than 32 bits:
+   at x 0 it is 641 * 6700419 - 643, which is 640 more than 2^32,
+   and only 2 * 6700419 - 2 at x 1 */
+static void
+test_skyline_waste (Fixture       *fixture,
+                    gconstpointer  user_data)
+{
+  GSkylinePacker *packer;
+  GRect r = {0, };
+
+  packer = g_object_new(G_TYPE_SKYLINE_PACKER,
+                        "width", 6700420,
+                        "height", 1000,
+                        "level", GSP_LEVEL_MIN_WASTE,
+                        NULL);
+
+  r.width = 1;
+  r.height = 641;
+  g_assert_true(g_skyline_packer_pack(packer, &r));
+  g_assert_cmpuint(r.x, ==, 0);
+
+  r.height = 2;
+  g_assert_true(g_skyline_packer_pack(packer, &r));
+  g_assert_cmpuint(r.x, ==, 1);
+
+  r.width = 6700419;
+  r.height = 1;
+  g_assert_true(g_skyline_packer_pack(packer, &r));
+  g_assert_cmpuint(r.x, ==, 1);
+  g_assert_cmpuint(r.y, ==, 2);
+
+  g_object_unref(packer);
+}
+
+/* a wide atlas with narrow glyphs makes for a long skyline */
+static void
+test_skyline_wide (Fixture       *fixture,
+                   gconstpointer  user_data)
+{
+  const guint width = g_test_perf() ? 16384 : 2048;
+  GSkylinePacker *packer;
+  GArray *sky;
+  GRand *rand;
+  guint i, n = 0, x = 0;
+  double ns;
+
+  packer = g_object_new(G_TYPE_SKYLINE_PACKER,
+                        "width", width,
+                        "height", 256,
+                        NULL);
+
+  rand = g_rand_new_with_seed(11);
+
+  g_test_timer_start();
+
+  for (;;)
+    {
+      GRect r = {0, };
+
+      r.width  = g_rand_int_range(rand, 2, 14);
+      r.height = g_rand_int_range(rand, 4, 28);
+      r.id = GUINT_TO_POINTER(n);
+
+      if (!g_skyline_packer_pack(packer, &r))
+        break;
+
+      n++;
+
+      /* give some of it back now and then */
+      if (n % 7 == 0)
+        g_assert_true(g_bin_packer_remove(G_BIN_PACKER(packer),
+                                          GUINT_TO_POINTER(n - 1)));
+    }
+
+  ns = g_test_timer_elapsed() * 1e9 / n;
+
+  g_object_get(packer, "skyline", &sky, NULL);
+
+  g_test_minimized_result(ns, "%u segments: %.1f ns per pack", sky->len, ns);
+
+  /* the segments cover the width without gaps and neighbours
+     never share a height */
+  for (i = 0; i < sky->len; i++)
+    {
+      const GRect *s = &g_array_index(sky, GRect, i);
+
+      g_assert_cmpuint(s->x, ==, x);
+      g_assert_cmpuint(s->width, >, 0);
+
+      if (i > 0)
+        g_assert_cmpuint(s->y, !=, g_array_index(sky, GRect, i - 1).y);
+
+      x += s->width;
+    }
+
+  g_assert_cmpuint(x, ==, width);
+
+  g_array_unref(sky);
+  g_rand_free(rand);
+  g_object_unref(packer);
+}
+
+static GArray *
+skyline_pack_random (gboolean use_wm)
+{
+  GSkylinePacker *packer;
+  GArray *bins, *packed, *all;
+  GRand *rand;
+  guint i;
+
+  packer = g_object_new(G_TYPE_SKYLINE_PACKER,
+                        "width", 256,
+                        "height", 256,
+                        "use-wastemap", use_wm,
+                        NULL);
+
+  rand = g_rand_new_with_seed(23);
+  bins = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+  all = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 1);
+
+  /* one at a time, like glyphs showing up in a cache */
+  for (i = 0; i < 400; i++)
+    {
+      GRect b = {0, };
+
+      b.width  = g_rand_int_range(rand, 2, 24);
+      b.height = g_rand_int_range(rand, 2, 24);
+      b.id = GUINT_TO_POINTER(i);
+
+      g_array_append_val(bins, b);
+      packed = g_skyline_packer_insert(packer, bins);
+      g_array_append_vals(all, packed->data, packed->len);
+
+      g_array_set_size(bins, 0);
+      g_array_free(packed, TRUE);
+    }
+
+  g_rand_free(rand);
+  g_array_free(bins, TRUE);
+  g_object_unref(packer);
+
+  return all;
+}
+
+static void
+test_skyline_wastemap (Fixture       *fixture,
+                       gconstpointer  user_data)
+{
+  GArray *plain, *wm;
+  guint i, k;
+
+  plain = skyline_pack_random(FALSE);
+  wm = skyline_pack_random(TRUE);
+
+  /* the gaps below the skyline get used */
+  g_assert_cmpuint(wm->len, >, plain->len);
+
+  for (i = 0; i < wm->len; i++)
+    {
+      const GRect *a = &g_array_index(wm, GRect, i);
+
+      g_assert_cmpuint(a->x + a->width, <=, 256);
+      g_assert_cmpuint(a->y + a->height, <=, 256);
+
+      for (k = i + 1; k < wm->len; k++)
+        {
+          const GRect *b = &g_array_index(wm, GRect, k);
+          GRect o;
+
+          g_assert_false(g_rect_intersect(a, b, &o));
+        }
+    }
+
+  g_array_free(plain, TRUE);
+  g_array_free(wm, TRUE);
+}
+
+static gfloat
+skyline_pack_batch (gboolean  offline,
+                    GArray  **packed)
+{
+  GSkylinePacker *packer;
+  GArray *bins;
+  GRand *rand;
+  gfloat occupancy;
+  guint i;
+
+  packer = g_object_new(G_TYPE_SKYLINE_PACKER,
+                        "width", 256,
+                        "height", 256,
+                        "offline", offline,
+                        NULL);
+
+  rand = g_rand_new_with_seed(42);
+  bins = g_array_sized_new(FALSE, FALSE, sizeof(GRect), 300);
+
+  /* more than fits, so that the order matters */
+  for (i = 0; i < 300; i++)
+    {
+      GRect b = {0, };
+
+      b.width  = g_rand_int_range(rand, 3, 40);
+      b.height = g_rand_int_range(rand, 3, 30);
+
+      g_array_append_val(bins, b);
+    }
+
+  *packed = g_skyline_packer_insert(packer, bins);
+  g_assert_cmpuint((*packed)->len + bins->len, ==, 300);
+
+  occupancy = g_bin_packer_occupancy(G_BIN_PACKER(packer));
+
+  g_rand_free(rand);
+  g_array_free(bins, TRUE);
+  g_object_unref(packer);
+
+  return occupancy;
+}
+
+static void
+test_skyline_offline (Fixture       *fixture,
+                      gconstpointer  user_data)
+{
+  GArray *online, *offline;
+  gfloat occ_online, occ_offline;
+  guint i, k;
+
+  occ_online = skyline_pack_batch(FALSE, &online);
+  occ_offline = skyline_pack_batch(TRUE, &offline);
+
+  g_test_message("occupancy: online %.3f, offline %.3f",
+                 occ_online, occ_offline);
+
+  g_assert_cmpfloat(occ_offline, >=, occ_online * 0.95);
+
+  for (i = 0; i < offline->len; i++)
+    {
+      const GRect *a = &g_array_index(offline, GRect, i);
+
+      /* placed tallest first */
+      if (i > 0)
+        g_assert_cmpuint(a->height, <=, g_array_index(offline, GRect, i - 1).height);
+
+      for (k = i + 1; k < offline->len; k++)
+        {
+          const GRect *b = &g_array_index(offline, GRect, k);
+          GRect o;
+
+          g_assert_false(g_rect_intersect(a, b, &o));
+        }
+    }
+
+  g_array_free(online, TRUE);
+  g_array_free(offline, TRUE);
+}
+
+static void
+test_packer_rotation (PackerFixture *fixture,
+                      gconstpointer  user_data)
+{
+  const struct {
+    GType       type;
+    const char *name;
+  } packers[] = {
+    {G_TYPE_GUILLOTINE_PACKER, "guillotine"},
+    {G_TYPE_SKYLINE_PACKER, "skyline"},
+    {G_TYPE_MAX_RECTS_PACKER, "max-rects"},
+    {G_TYPE_SHELF_PACKER, "shelf"},
+  };
+  guint p, turn;
+
+  /* half the usual atlas so that the glyphs do not all fit */
+  for (p = 0; p < G_N_ELEMENTS(packers); p++)
+    {
+      gfloat occupancy[2];
+
+      for (turn = 0; turn < 2; turn++)
+        {
+          GBinPacker *packer;
+          GArray *bins, *packed;
+          guint i, k;
+
+          bins = g_array_sized_new(FALSE, FALSE, sizeof(GRect),
+                                   fixture->bins->len);
+          g_array_append_vals(bins, fixture->bins->data, fixture->bins->len);
+
+          packer = g_object_new(packers[p].type,
+                                "width", fixture->width,
+                                "height", fixture->height / 2,
+                                "allow-rotation", turn == 1,
+                                NULL);
+
+          packed = g_bin_packer_insert(packer, bins);
+          occupancy[turn] = g_bin_packer_occupancy(packer);
+
+          for (i = 0; i < packed->len; i++)
+            {
+              const GRect *a = &g_array_index(packed, GRect, i);
+              const GlyphInfo *info = a->id;
+
+              g_assert_true(turn == 1 || !a->rotated);
+
+              if (a->rotated)
+                {
+                  g_assert_cmpuint(a->width, ==, info->ink.height + 1);
+                  g_assert_cmpuint(a->height, ==, info->ink.width + 1);
+                }
+              else
+                {
+                  g_assert_cmpuint(a->width, ==, info->ink.width + 1);
+                  g_assert_cmpuint(a->height, ==, info->ink.height + 1);
+                }
+
+              for (k = i + 1; k < packed->len; k++)
+                {
+                  const GRect *b = &g_array_index(packed, GRect, k);
+                  GRect o;
+
+                  g_assert_false(g_rect_intersect(a, b, &o));
+                }
+            }
+
+          g_array_free(packed, TRUE);
+          g_array_free(bins, TRUE);
+          g_object_unref(packer);
+        }
+
+      g_test_message("%s: occupancy %.3f, %.3f with rotation",
+                     packers[p].name, occupancy[0], occupancy[1]);
+
+      g_test_maximized_result(occupancy[1] - occupancy[0],
+                              "%s: rotation gains %.3f",
+                              packers[p].name, occupancy[1] - occupancy[0]);
+    }
+}
+static void
+test_packer_padding (Fixture       *fixture,
+                     gconstpointer  user_data)
+{
+  struct {
+    GType    type;
+    gboolean turn;
+  } packers[] = {
+    {G_TYPE_GUILLOTINE_PACKER, FALSE},
+    {G_TYPE_GUILLOTINE_PACKER, TRUE},
+    {G_TYPE_SKYLINE_PACKER,    FALSE},
+    {G_TYPE_SKYLINE_PACKER,    TRUE},
+    {G_TYPE_MAX_RECTS_PACKER,  FALSE},
+    {G_TYPE_MAX_RECTS_PACKER,  TRUE},
+    {G_TYPE_SHELF_PACKER,      FALSE},
+    {G_TYPE_SHELF_PACKER,      TRUE},
+  };
+  const guint padding = 1, alignment = 4;
+  const guint n_bins = 300;
+  GRect *bins;
+  GRand *rand;
+  guint i, k, p;
+
+  bins = g_new0(GRect, n_bins);
+  rand = g_rand_new_with_seed(11);
+
+  for (i = 0; i < n_bins; i++)
+    {
+      bins[i].width  = g_rand_int_range(rand, 1, 30);
+      bins[i].height = g_rand_int_range(rand, 1, 30);
+      bins[i].id = GUINT_TO_POINTER(i);
+    }
+
+  for (p = 0; p < G_N_ELEMENTS(packers); p++)
+    {
+      GBinPacker *packer;
+      GArray *rest, *out, *rects;
+
+      packer = g_object_new(packers[p].type,
+                            "width", 256,
+                            "height", 256,
+                            "allow-rotation", packers[p].turn,
+                            "padding", padding,
+                            "alignment", alignment,
+                            NULL);
+
+      /* half of them at once, then every other one of those is
+         removed again and the rest packed one by one */
+      rest = g_array_sized_new(FALSE, FALSE, sizeof(GRect), n_bins);
+      g_array_append_vals(rest, bins, n_bins / 2);
+      out = g_bin_packer_insert(packer, rest);
+      g_assert_cmpuint(out->len, >, 0);
+
+      for (i = 0; i < out->len; i += 2)
+        g_assert_true(g_bin_packer_remove(packer,
+                                          g_array_index(out, GRect, i).id));
+
+      for (i = n_bins / 2; i < n_bins; i++)
+        {
+          GRect r = bins[i];
+
+          g_bin_packer_pack(packer, &r);
+
+          if (r.x == G_RECT_UNPLACED)
+            {
+              g_assert_cmpuint(r.width, ==, bins[i].width);
+              g_assert_cmpuint(r.height, ==, bins[i].height);
+            }
+        }
+
+      g_object_get(packer, "rects", &rects, NULL);
+      g_assert_cmpuint(rects->len, >, out->len / 2);
+
+      for (i = 0; i < rects->len; i++)
+        {
+          const GRect *a = &g_array_index(rects, GRect, i);
+          const GRect *q = &bins[GPOINTER_TO_UINT(a->id)];
+          GRect pa = *a;
+
+          /* their own size, at a block boundary, with a gutter */
+          g_assert_cmpuint(a->x % alignment, ==, 0);
+          g_assert_cmpuint(a->y % alignment, ==, 0);
+
+          if (a->rotated)
+            {
+              g_assert_cmpuint(a->width, ==, q->height);
+              g_assert_cmpuint(a->height, ==, q->width);
+            }
+          else
+            {
+              g_assert_cmpuint(a->width, ==, q->width);
+              g_assert_cmpuint(a->height, ==, q->height);
+            }
+
+          pa.width += padding;
+          pa.height += padding;
+
+          for (k = 0; k < rects->len; k++)
+            {
+              const GRect *b = &g_array_index(rects, GRect, k);
+              GRect o;
+
+              if (k != i)
+                g_assert_false(g_rect_intersect(&pa, b, &o));
+            }
+        }
+
+      if (G_IS_GUILLOTINE_PACKER(packer))
+        g_assert_null(g_guillotine_packer_check(G_GUILLOTINE_PACKER(packer)));
+
+      if (G_IS_MAX_RECTS_PACKER(packer))
+        g_assert_null(g_max_rects_packer_check(G_MAX_RECTS_PACKER(packer)));
+
+      g_array_unref(rects);
+      g_array_free(out, TRUE);
+      g_array_free(rest, TRUE);
+      g_object_unref(packer);
+    }
+
+  g_rand_free(rand);
+  g_free(bins);
+}
+static void
+test_packer_snapshot (Fixture       *fixture,
+                      gconstpointer  user_data)
+{
+  struct {
+    GType    type;
+    gboolean use_wm;
+    guint    min_free;  /* of the guillotine */
+  } packers[] = {
+    {G_TYPE_GUILLOTINE_PACKER, FALSE, 0},
+    {G_TYPE_GUILLOTINE_PACKER, FALSE, G_GUILLOTINE_PACKER_MIN_FREE_AUTO},
+    {G_TYPE_SKYLINE_PACKER,    FALSE, 0},
+    {G_TYPE_SKYLINE_PACKER,    TRUE,  0},
+    {G_TYPE_MAX_RECTS_PACKER,  FALSE, 0},
+    {G_TYPE_SHELF_PACKER,      FALSE, 0},
+  };
+  const guint n_bins = 400;
+  GRect *bins;
+  GRand *rand;
+  guint i, p;
+
+  bins = g_new0(GRect, n_bins);
+  rand = g_rand_new_with_seed(5);
+
+  for (i = 0; i < n_bins; i++)
+    {
+      bins[i].width  = g_rand_int_range(rand, 4, 40);
+      bins[i].height = g_rand_int_range(rand, 4, 40);
+      bins[i].id = GUINT_TO_POINTER(i + 1);
+    }
+
+  for (p = 0; p < G_N_ELEMENTS(packers); p++)
+    {
+      GBinPacker *a, *b;
+      GArray *ra, *rb;
+      GError *error = NULL;
+      GBytes *snap, *bad;
+      guint8 *data;
+      gsize size;
+      guint32 version;
+
+      if (packers[p].type == G_TYPE_SKYLINE_PACKER)
+        a = g_object_new(packers[p].type,
+                         "width", 256,
+                         "height", 256,
+                         "allow-rotation", TRUE,
+                         "padding", 1,
+                         "use-wastemap", packers[p].use_wm,
+                         NULL);
+      else if (packers[p].type == G_TYPE_GUILLOTINE_PACKER)
+        a = g_object_new(packers[p].type,
+                         "width", 256,
+                         "height", 256,
+                         "allow-rotation", TRUE,
+                         "padding", 1,
+                         "min-free-size", packers[p].min_free,
+                         NULL);
+      else
+        a = g_object_new(packers[p].type,
+                         "width", 256,
+                         "height", 256,
+                         "allow-rotation", TRUE,
+                         "padding", 1,
+                         NULL);
+
+      /* some state worth saving, holes included */
+      for (i = 0; i < n_bins / 4; i++)
+        {
+          GRect r = bins[i];
+          g_bin_packer_pack(a, &r);
+        }
+
+      for (i = 0; i < n_bins / 4; i += 3)
+        g_bin_packer_remove(a, bins[i].id);
+
+      snap = g_bin_packer_save(a);
+      b = g_bin_packer_load(snap, &error);
+      g_assert_no_error(error);
+      g_assert_true(G_OBJECT_TYPE(b) == G_OBJECT_TYPE(a));
+
+      /* it carries on exactly like the original */
+      for (i = n_bins / 4; i < n_bins; i++)
+        {
+          GRect r = bins[i], q = bins[i];
+
+          g_assert_cmpint(g_bin_packer_pack(a, &r), ==, g_bin_packer_pack(b, &q));
+          g_assert_cmpuint(r.x, ==, q.x);
+          g_assert_cmpuint(r.y, ==, q.y);
+          g_assert_cmpint(r.rotated, ==, q.rotated);
+        }
+
+      g_object_get(a, "rects", &ra, NULL);
+      g_object_get(b, "rects", &rb, NULL);
+      g_assert_cmpuint(ra->len, ==, rb->len);
+      g_assert_cmpmem(ra->data, ra->len * sizeof(GRect),
+                      rb->data, rb->len * sizeof(GRect));
+
+      /* damaged and future snapshots are refused */
+      size = g_bytes_get_size(snap);
+      data = g_malloc(size);
+      memcpy(data, g_bytes_get_data(snap, NULL), size);
+
+      bad = g_bytes_new(data, size - 1);
+      g_assert_null(g_bin_packer_load(bad, &error));
+      g_assert_error(error, G_BIN_PACKER_ERROR, G_BIN_PACKER_ERROR_INVALID);
+      g_clear_error(&error);
+      g_bytes_unref(bad);
+
+      memcpy(&version, data + 4, sizeof(version));
+      version = GUINT32_TO_LE(GUINT32_FROM_LE(version) + 1);
+      memcpy(data + 4, &version, sizeof(version));
+
+      bad = g_bytes_new_take(data, size);
+      g_assert_null(g_bin_packer_load(bad, &error));
+      g_assert_error(error, G_BIN_PACKER_ERROR, G_BIN_PACKER_ERROR_VERSION);
+      g_clear_error(&error);
+      g_bytes_unref(bad);
+
+      g_array_unref(ra);
+      g_array_unref(rb);
+      g_bytes_unref(snap);
+      g_object_unref(a);
+      g_object_unref(b);
+    }
+
+  g_rand_free(rand);
+  g_free(bins);
+}
+
+/* the stats kept along the way against ones worked out from
+   scratch */
+static void
+check_stats(GBinPacker *packer,
+            gboolean    use_wm)
+{
+  GBinPackerStats st;
+  GArray *rects, *list = NULL;
+  guint64 used = 0, below = 0;
+  guint64 largest = 0;
+  guint width, height;
+  guint i;
+
+  g_bin_packer_get_stats(packer, &st);
+  g_object_get(packer,
+               "rects", &rects,
+               "width", &width,
+               "height", &height,
+               NULL);
+
+  for (i = 0; i < rects->len; i++)
+    used += g_rect_area(&g_array_index(rects, GRect, i));
+
+  g_assert_cmpuint(st.used_area, ==, used);
+  g_assert_cmpfloat(g_bin_packer_occupancy(packer), ==,
+                    (gfloat) (used / (gdouble) (width * height)));
+
+  if (G_IS_SKYLINE_PACKER(packer))
+    {
+      g_object_get(packer, "skyline", &list, NULL);
+      g_assert_cmpuint(st.n_segments, ==, list->len);
+
+      for (i = 0; i < list->len; i++)
+        {
+          const GRect *n = &g_array_index(list, GRect, i);
+          below += (guint64) n->width * n->y;
+        }
+
+      g_assert_cmpuint(st.waste_area, ==, below - used);
+      g_array_unref(list);
+      list = NULL;
+    }
+  else if (G_IS_SHELF_PACKER(packer))
+    {
+      g_object_get(packer, "shelves", &list, NULL);
+      g_assert_cmpuint(st.n_segments, ==, list->len);
+      g_array_unref(list);
+      list = NULL;
+    }
+  else
+    g_object_get(packer, "free-rects", &list, NULL);
+
+  if (list)
+    {
+      g_assert_cmpuint(st.n_free_rects, ==, list->len);
+
+      for (i = 0; i < list->len; i++)
+        largest = MAX(largest, g_rect_area(&g_array_index(list, GRect, i)));
+
+      g_assert_cmpuint(g_rect_area(&st.largest_free), ==, largest);
+      g_array_unref(list);
+    }
+  else if (!use_wm)
+    g_assert_cmpuint(st.n_free_rects, ==, 0);
+
+  g_array_unref(rects);
+}
+
+static void
+test_packer_stats (Fixture       *fixture,
+                   gconstpointer  user_data)
+{
+  struct {
+    GType    type;
+    gboolean use_wm;
+    guint    fit;
+  } packers[] = {
+    {G_TYPE_GUILLOTINE_PACKER, FALSE, G_RECT_FIT_AREA_BEST},
+    {G_TYPE_GUILLOTINE_PACKER, FALSE, G_RECT_FIT_AREA_WORST},
+    {G_TYPE_SKYLINE_PACKER,    FALSE, 0},
+    {G_TYPE_SKYLINE_PACKER,    TRUE,  0},
+    {G_TYPE_MAX_RECTS_PACKER,  FALSE, G_RECT_FIT_AREA_BEST},
+    {G_TYPE_SHELF_PACKER,      FALSE, 0},
+  };
+  const guint n_bins = 600;
+  GRect *bins;
+  GRand *rand;
+  guint i, p;
+
+  bins = g_new0(GRect, n_bins);
+  rand = g_rand_new_with_seed(22);
+
+  for (i = 0; i < n_bins; i++)
+    {
+      bins[i].width  = g_rand_int_range(rand, 2, 40);
+      bins[i].height = g_rand_int_range(rand, 2, 40);
+      bins[i].id = GUINT_TO_POINTER(i + 1);
+    }
+
+  for (p = 0; p < G_N_ELEMENTS(packers); p++)
+    {
+      GBinPacker *packer;
+
+      if (packers[p].type == G_TYPE_SKYLINE_PACKER)
+        packer = g_object_new(packers[p].type,
+                              "width", 256,
+                              "height", 256,
+                              "padding", 1,
+                              "use-wastemap", packers[p].use_wm,
+                              NULL);
+      else if (packers[p].type == G_TYPE_SHELF_PACKER)
+        packer = g_object_new(packers[p].type,
+                              "width", 256,
+                              "height", 256,
+                              "padding", 1,
+                              NULL);
+      else
+        packer = g_object_new(packers[p].type,
+                              "width", 256,
+                              "height", 256,
+                              "padding", 1,
+                              "fit-method", packers[p].fit,
+                              NULL);
+
+      check_stats(packer, packers[p].use_wm);
+
+      for (i = 0; i < n_bins; i++)
+        {
+          GRect r = bins[i];
+          g_bin_packer_pack(packer, &r);
+
+          if (i % 3 == 2)
+            g_bin_packer_remove(packer, bins[i - 1].id);
+
+          if (i % 50 == 0)
+            check_stats(packer, packers[p].use_wm);
+
+          if (i == n_bins / 2)
+            {
+              g_assert_true(g_bin_packer_grow(packer, 320, 320));
+              check_stats(packer, packers[p].use_wm);
+            }
+        }
+
+      check_stats(packer, packers[p].use_wm);
+      g_object_unref(packer);
+    }
+
+  g_rand_free(rand);
+  g_free(bins);
+}
+
+typedef struct {
+  guint begun;
+  guint ended;
+  guint n_begin;
+  guint n_end;
+} TraceLog;
+
+static void
+trace_record(GBinPacker           *packer,
+             GBinPackerTracePhase  phase,
+             guint                 n,
+             gpointer              user_data)
+{
+  TraceLog *log = user_data;
+
+  if (phase == G_BIN_PACKER_TRACE_BEGIN)
+    {
+      g_assert_cmpuint(log->begun, ==, log->ended);
+      log->begun++;
+      log->n_begin += n;
+    }
+  else
+    {
+      log->ended++;
+      log->n_end += n;
+    }
+}
+
+static void
+test_packer_counters (Fixture       *fixture,
+                      gconstpointer  user_data)
+{
+  struct {
+    GType    type;
+    gboolean use_wm;
+  } packers[] = {
+    {G_TYPE_GUILLOTINE_PACKER, FALSE},
+    {G_TYPE_SKYLINE_PACKER,    FALSE},
+    {G_TYPE_SKYLINE_PACKER,    TRUE},
+    {G_TYPE_MAX_RECTS_PACKER,  FALSE},
+    {G_TYPE_SHELF_PACKER,      FALSE},
+  };
+  const guint n_bins = 300;
+  GArray *bins;
+  GRand *rand;
+  guint i, p;
+
+  bins = g_array_sized_new(FALSE, FALSE, sizeof(GRect), n_bins);
+  rand = g_rand_new_with_seed(23);
+
+  for (i = 0; i < n_bins; i++)
+    {
+      GRect r = {0, };
+
+      r.width  = g_rand_int_range(rand, 4, 40);
+      r.height = g_rand_int_range(rand, 4, 40);
+      r.id = GUINT_TO_POINTER(i + 1);
+      g_array_append_val(bins, r);
+    }
+
+  for (p = 0; p < G_N_ELEMENTS(packers); p++)
+    {
+      GBinPacker *packer, *quiet;
+      GBinPackerCounters c;
+      TraceLog log = {0, };
+      GArray *left, *packed;
+      guint n_failed;
+      GRect r;
+
+      if (packers[p].type == G_TYPE_SKYLINE_PACKER)
+        packer = g_object_new(packers[p].type,
+                              "width", 256,
+                              "height", 256,
+                              "counting", TRUE,
+                              "use-wastemap", packers[p].use_wm,
+                              NULL);
+      else if (packers[p].type == G_TYPE_GUILLOTINE_PACKER)
+        packer = g_object_new(packers[p].type,
+                              "width", 256,
+                              "height", 256,
+                              "counting", TRUE,
+                              "merge-free", TRUE,
+                              NULL);
+      else
+        packer = g_object_new(packers[p].type,
+                              "width", 256,
+                              "height", 256,
+                              "counting", TRUE,
+                              NULL);
+
+      quiet = g_object_new(packers[p].type,
+                           "width", 256,
+                           "height", 256,
+                           NULL);
+
+      g_bin_packer_set_trace_func(packer, trace_record, &log);
+
+      left = g_array_sized_new(FALSE, FALSE, sizeof(GRect), n_bins);
+      g_array_append_vals(left, bins->data, n_bins / 2);
+      packed = g_bin_packer_insert(packer, left);
+
+      g_assert_cmpuint(log.begun, ==, 1);
+      g_assert_cmpuint(log.ended, ==, 1);
+      g_assert_cmpuint(log.n_begin, ==, n_bins / 2);
+      g_assert_cmpuint(log.n_end, ==, packed->len);
+
+      /* the atlas is too small for all of them */
+      n_failed = left->len;
+      for (i = n_bins / 2; i < n_bins; i++)
+        {
+          r = g_array_index(bins, GRect, i);
+          n_failed += !g_bin_packer_pack(packer, &r);
+        }
+
+      for (i = 0; i < packed->len; i += 2)
+        g_bin_packer_remove(packer, g_array_index(packed, GRect, i).id);
+
+      g_bin_packer_get_counters(packer, &c);
+      g_assert_cmpuint(c.scored, >, 0);
+      g_assert_cmpuint(n_failed, >, 0);
+      g_assert_cmpuint(c.failed, ==, n_failed);
+
+      if (packers[p].type == G_TYPE_SKYLINE_PACKER)
+        g_assert_cmpuint(c.segments, >, 0);
+      else
+        g_assert_cmpuint(c.segments, ==, 0);
+
+      if (packers[p].type == G_TYPE_GUILLOTINE_PACKER || packers[p].use_wm)
+        g_assert_cmpuint(c.merges, >, 0);
+
+      /* only one trace per batch, none for single rects */
+      g_assert_cmpuint(log.begun, ==, 1);
+
+      g_bin_packer_reset_counters(packer);
+      g_bin_packer_get_counters(packer, &c);
+      g_assert_cmpuint(c.scored + c.merges + c.segments + c.failed, ==, 0);
+
+      g_bin_packer_set_trace_func(packer, NULL, NULL);
+      r = g_array_index(bins, GRect, 0);
+      g_bin_packer_pack(packer, &r);
+      g_assert_cmpuint(log.ended, ==, 1);
+
+      /* nothing is counted unless asked for */
+      r = g_array_index(bins, GRect, 0);
+      g_bin_packer_pack(quiet, &r);
+      g_bin_packer_get_counters(quiet, &c);
+      g_assert_cmpuint(c.scored + c.merges + c.segments + c.failed, ==, 0);
+
+      g_array_free(packed, TRUE);
+      g_array_free(left, TRUE);
+      g_object_unref(quiet);
+      g_object_unref(packer);
+    }
+
+  g_rand_free(rand);
+  g_array_free(bins, TRUE);
+}
+
+static void
+test_packer_check (Fixture       *fixture,
+                   gconstpointer  user_data)
+{
+  struct {
+    GType    type;
+    gboolean use_wm;
+  } packers[] = {
+    {G_TYPE_GUILLOTINE_PACKER, FALSE},
+    {G_TYPE_SKYLINE_PACKER,    FALSE},
+    {G_TYPE_SKYLINE_PACKER,    TRUE},
+    {G_TYPE_MAX_RECTS_PACKER,  FALSE},
+    {G_TYPE_SHELF_PACKER,      FALSE},
+  };
+  const guint n_bins = g_test_perf() ? 100000 : 2000;
+  const guint side = g_test_perf() ? 4096 : 512;
+  GRect *bins;
+  GRand *rand;
+  guint i, p;
+
+  bins = g_new0(GRect, n_bins);
+  rand = g_rand_new_with_seed(21);
+
+  for (i = 0; i < n_bins; i++)
+    {
+      bins[i].width  = g_rand_int_range(rand, 2, 24);
+      bins[i].height = g_rand_int_range(rand, 2, 24);
+      bins[i].id = GUINT_TO_POINTER(i + 1);
+    }
+
+  for (p = 0; p < G_N_ELEMENTS(packers); p++)
+    {
+      GBinPacker *a;
+      GArray *rects, *bad;
+      GError *error = NULL;
+      GBytes *snap, *broken;
+      guint32 words[5];
+      guint8 *data;
+      gdouble elapsed;
+      gsize size;
+      gssize at;
+
+      if (packers[p].type == G_TYPE_SKYLINE_PACKER)
+        a = g_object_new(packers[p].type,
+                         "width", side,
+                         "height", side,
+                         "allow-rotation", TRUE,
+                         "padding", 1,
+                         "use-wastemap", packers[p].use_wm,
+                         NULL);
+      else
+        a = g_object_new(packers[p].type,
+                         "width", side,
+                         "height", side,
+                         "allow-rotation", TRUE,
+                         "padding", 1,
+                         NULL);
+
+      for (i = 0; i < n_bins; i++)
+        {
+          GRect r = bins[i];
+          g_bin_packer_pack(a, &r);
+
+          if (i % 5 == 4)
+            g_bin_packer_remove(a, bins[i - 2].id);
+        }
+
+      g_test_timer_start();
+      bad = g_bin_packer_check(a);
+      elapsed = g_test_timer_elapsed();
+      g_test_minimized_result(elapsed, "%s: %.3f s to check",
+                              G_OBJECT_TYPE_NAME(a), elapsed);
+      g_assert_null(bad);
+
+      /* move the second packed rect onto the first one */
+      g_object_get(a, "rects", &rects, NULL);
+      g_assert_cmpuint(rects->len, >, 2);
+
+      snap = g_bin_packer_save(a);
+      size = g_bytes_get_size(snap);
+      data = g_malloc(size);
+      memcpy(data, g_bytes_get_data(snap, NULL), size);
+
+      words[0] = g_array_index(rects, GRect, 1).x;
+      words[1] = g_array_index(rects, GRect, 1).y;
+      words[2] = g_array_index(rects, GRect, 1).width;
+      words[3] = g_array_index(rects, GRect, 1).height;
+      words[4] = g_array_index(rects, GRect, 1).rotated;
+      at = find_words(data, size, words, 5);
+      g_assert_cmpint(at, >=, 0);
+
+      /* the check is what refuses the overlap */
+      words[0] = GUINT32_TO_LE(g_array_index(rects, GRect, 0).x);
+      words[1] = GUINT32_TO_LE(g_array_index(rects, GRect, 0).y);
+      memcpy(data + at, words, 2 * sizeof(guint32));
+
+      broken = g_bytes_new(data, size);
+      g_assert_null(g_bin_packer_load(broken, &error));
+      g_assert_error(error, G_BIN_PACKER_ERROR, G_BIN_PACKER_ERROR_INVALID);
+      g_clear_error(&error);
+      g_bytes_unref(broken);
+
+      /* and then out of the packer */
+      words[0] = GUINT32_TO_LE(side);
+      words[1] = GUINT32_TO_LE(0);
+      memcpy(data + at, words, 2 * sizeof(guint32));
+
+      broken = g_bytes_new(data, size);
+      g_assert_null(g_bin_packer_load(broken, &error));
+      g_assert_error(error, G_BIN_PACKER_ERROR, G_BIN_PACKER_ERROR_INVALID);
+      g_clear_error(&error);
+      g_bytes_unref(broken);
+      g_free(data);
+
+      /* a free rect that reaches out of the packer */
+      if (g_object_class_find_property(G_OBJECT_GET_CLASS(a), "free-rects"))
+        {
+          GArray *rfree;
+          GRect f;
+
+          g_object_get(a, "free-rects", &rfree, NULL);
+          g_assert_cmpuint(rfree->len, >, 0);
+          f = g_array_index(rfree, GRect, rfree->len - 1);
+          g_array_unref(rfree);
+
+          data = g_malloc(size);
+          memcpy(data, g_bytes_get_data(snap, NULL), size);
+
+          words[0] = f.x;
+          words[1] = f.y;
+          words[2] = f.width;
+          words[3] = f.height;
+          at = find_words(data, size, words, 4);
+          g_assert_cmpint(at, >=, 0);
+
+          words[0] = GUINT32_TO_LE(5000);
+          memcpy(data + at + 2 * sizeof(guint32), words, sizeof(guint32));
+
+          broken = g_bytes_new_take(data, size);
+          g_assert_null(g_bin_packer_load(broken, &error));
+          g_assert_error(error, G_BIN_PACKER_ERROR, G_BIN_PACKER_ERROR_INVALID);
+          g_clear_error(&error);
+          g_bytes_unref(broken);
+        }
+
+      g_array_unref(rects);
+      g_bytes_unref(snap);
+      g_object_unref(a);
+    }
+
+  g_rand_free(rand);
+  g_free(bins);
+}
+
+int
+main (int argc, char **argv)
+{
+  setlocale(LC_ALL, "");
+
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add("/bin-packer/rect",
+	     Fixture, NULL,
+	     NULL,
+	     test_rect_basic,
+	     NULL);
+
+  g_test_add("/bin-packer/rect/merge",
+	     Fixture, NULL,
+	     NULL,
+	     test_rect_merge,
+	     NULL);
+
+  /* the packers */
+  g_test_add("/bin-packer/packer/guillotine",
+             PackerFixture, NULL,
+             fixture_set_up,
+             test_guillotine_packer,
+             fixture_tear_down);
+
+  g_test_add("/bin-packer/packer/guillotine/index",
+             Fixture, NULL,
+             NULL,
+             test_guillotine_index,
+             NULL);
+
+  g_test_add("/bin-packer/packer/guillotine/exact",
+             Fixture, NULL,
+             NULL,
+             test_guillotine_exact,
+             NULL);
+
+  g_test_add("/bin-packer/packer/guillotine/park",
+             Fixture, NULL,
+             NULL,
+             test_guillotine_park,
+             NULL);
+
+  g_test_add("/bin-packer/packer/guillotine/merge",
+             Fixture, NULL,
+             NULL,
+             test_guillotine_merge,
+             NULL);
+
+  g_test_add("/bin-packer/packer/skyline",
+             PackerFixture, NULL,
+             fixture_set_up,
+             test_skyline_packer,
+             fixture_tear_down);
+
+  g_test_add("/bin-packer/packer/max-rects",
+             PackerFixture, NULL,
+             fixture_set_up,
+             test_max_rects_packer,
+             fixture_tear_down);
+
+  g_test_add("/bin-packer/packer/max-rects/scan",
+             Fixture, NULL,
+             NULL,
+             test_max_rects_scan,
+             NULL);
+
+  g_test_add("/bin-packer/packer/shelf",
+             PackerFixture, NULL,
+             fixture_set_up,
+             test_shelf_packer,
+             fixture_tear_down);
+
+  g_test_add("/bin-packer/packer/remove",
+             Fixture, NULL,
+             NULL,
+             test_packer_remove,
+             NULL);
+
+  g_test_add("/bin-packer/packer/grow",
+             Fixture, NULL,
+             NULL,
+             test_packer_grow,
+             NULL);
+
+  g_test_add("/bin-packer/packer/wide",
+             Fixture, NULL,
+             NULL,
+             test_packer_wide,
+             NULL);
+
+  g_test_add("/bin-packer/pool",
+             Fixture, NULL,
+             NULL,
+             test_packer_pool,
+             NULL);
+
+  g_test_add("/bin-packer/packer/pack",
+             Fixture, NULL,
+             NULL,
+             test_packer_pack,
+             NULL);
+
+  g_test_add("/bin-packer/packer/place",
+             Fixture, NULL,
+             NULL,
+             test_packer_place,
+             NULL);
+
+  g_test_add("/bin-packer/packer/compare",
+             PackerFixture, NULL,
+             fixture_set_up,
+             test_packer_compare,
+             fixture_tear_down);
+
+  g_test_add("/bin-packer/packer/skyline/level",
+             PackerFixture, NULL,
+             fixture_set_up,
+             test_skyline_level,
+             fixture_tear_down);
+
+  g_test_add("/bin-packer/packer/skyline/waste",
+             Fixture, NULL,
+             NULL,
+             test_skyline_waste,
+             NULL);
+
+  g_test_add("/bin-packer/packer/skyline/wide",
+             Fixture, NULL,
+             NULL,
+             test_skyline_wide,
+             NULL);
+
+  g_test_add("/bin-packer/packer/skyline/wastemap",
+             Fixture, NULL,
+             NULL,
+             test_skyline_wastemap,
+             NULL);
+
+  g_test_add("/bin-packer/packer/skyline/offline",
+             Fixture, NULL,
+             NULL,
+             test_skyline_offline,
+             NULL);
+
+  g_test_add("/bin-packer/packer/rotation",
+             PackerFixture, NULL,
+             fixture_set_up,
+             test_packer_rotation,
+             fixture_tear_down);
+
+  g_test_add("/bin-packer/packer/padding",
+             Fixture, NULL,
+             NULL,
+             test_packer_padding,
+             NULL);
+
+  g_test_add("/bin-packer/packer/snapshot",
+             Fixture, NULL,
+             NULL,
+             test_packer_snapshot,
+             NULL);
+
+  g_test_add("/bin-packer/packer/check",
+             Fixture, NULL,
+             NULL,
+             test_packer_check,
+             NULL);
+
+  g_test_add("/bin-packer/packer/stats",
+             Fixture, NULL,
+             NULL,
+             test_packer_stats,
+             NULL);
+
+  g_test_add("/bin-packer/packer/counters",
+             Fixture, NULL,
+             NULL,
+             test_packer_counters,
+             NULL);
 
   return g_test_run();
 }